@@ -1,9 +1,40 @@
 #include "devices/block.h"
+#include <inttypes.h>
 #include <list.h>
 #include <string.h>
 #include <stdio.h>
 #include "devices/ide.h"
+#include "devices/timer.h"
+#include "threads/condvar.h"
+#include "threads/interrupt.h"
+#include "threads/lock.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/semaphore.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Number of timer ticks that a read and a write request may wait
+   before it is served ahead of its turn.  Reads usually have a
+   thread waiting for them, writes seldom do. */
+#define READ_EXPIRE (TIMER_FREQ / 2)
+#define WRITE_EXPIRE (5 * TIMER_FREQ)
+
+/* Requests are merged into transfers of at most this many pages. */
+#define MERGE_PAGES 4
+#define MERGE_SECTORS (MERGE_PAGES * PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* Request latencies, from submission to completion, are counted
+   in buckets by their base-2 logarithm in CPU cycles: bucket N
+   holds those of 2**N to 2**(N+1) - 1 cycles. */
+#define LATENCY_BUCKETS 40
+
+/* Queue depths seen by submitted requests are counted in buckets
+   0 through DEPTH_BUCKETS - 1, the last one for deeper queues. */
+#define DEPTH_BUCKETS 16
+
+/* Number of the most recent requests that the trace keeps. */
+#define TRACE_SIZE 256
 
 /* A block device. */
 struct block
@@ -19,8 +50,43 @@ struct block
 
     unsigned long long read_cnt;        /* Number of sectors read. */
     unsigned long long write_cnt;       /* Number of sectors written. */
+
+    /* Request queue, unless the driver passes requests on to
+       another device through its `submit' operation. */
+    struct lock queue_lock;             /* Protects the members below. */
+    struct condvar queue_ready;         /* Signaled when a request comes. */
+    struct list queue;                  /* Pending requests, by sector. */
+    struct list fifo;                   /* Pending requests, oldest first. */
+    block_sector_t head;                /* Sector after the last served. */
+    uint8_t *merge_buf;                 /* MERGE_PAGES pages, or null. */
+    size_t pending_cnt;                 /* Requests submitted but not done. */
+    unsigned long long depth_cnt[DEPTH_BUCKETS]; /* By pending_cnt at
+                                                    submission. */
+
+    /* Requests done, by direction (read, then write) and latency.
+       Updated only by the device's thread. */
+    unsigned long long latency_cnt[2][LATENCY_BUCKETS];
   };
 
+/* A completed request, as recorded in the trace. */
+struct trace_entry
+  {
+    struct block *block;                /* Device. */
+    block_sector_t sector;              /* First sector. */
+    uint32_t cnt;                       /* Number of sectors. */
+    bool write;                         /* Write, rather than read? */
+    int tid;                            /* Submitting thread. */
+    uint64_t latency;                   /* Cycles from submit to done. */
+  };
+
+/* Ring buffer of the last TRACE_SIZE requests completed, if
+   tracing is enabled.  Entry trace_cnt % TRACE_SIZE is the next
+   to be overwritten.  Accessed with interrupts off, since several
+   devices' threads write to it. */
+static bool trace_enabled;
+static struct trace_entry trace[TRACE_SIZE];
+static unsigned long long trace_cnt;
+
 /* List of all block devices. */
 static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 
@@ -28,6 +94,18 @@ static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 static struct block *block_by_role[BLOCK_ROLE_CNT];
 
 static struct block *list_elem_to_block (struct list_elem *);
+static void block_wait (struct block *, bool write, block_sector_t,
+                        size_t cnt, void *);
+static thread_func block_worker;
+
+/* Returns the CPU's time-stamp counter. */
+static inline uint64_t
+rdtsc (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
 
 /* Returns a human-readable name for the given block device
    TYPE. */
@@ -120,9 +198,7 @@ check_sector (struct block *block, block_sector_t sector)
 void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
-  check_sector (block, sector);
-  block->ops->read (block->aux, sector, buffer);
-  block->read_cnt++;
+  block_wait (block, false, sector, 1, buffer);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -132,11 +208,332 @@ block_read (struct block *block, block_sector_t sector, void *buffer)
    per-block device locking is unneeded. */
 void
 block_write (struct block *block, block_sector_t sector, const void *buffer)
+{
+  block_wait (block, true, sector, 1, (void *) buffer);
+}
+
+/* Verifies that the CNT sectors starting at SECTOR are all
+   within BLOCK.  Panics if not. */
+static void
+check_sectors (struct block *block, block_sector_t sector, size_t cnt)
 {
   check_sector (block, sector);
-  ASSERT (block->type != BLOCK_FOREIGN);
-  block->ops->write (block->aux, sector, buffer);
-  block->write_cnt++;
+  if (cnt > block->size - sector)
+    PANIC ("Access past end of device %s (sector=%"PRDSNu", count=%zu, "
+           "size=%"PRDSNu")\n", block_name (block), sector, cnt,
+           block->size);
+}
+
+/* Reads the CNT sectors starting at SECTOR from BLOCK into
+   BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE
+   bytes.  Drivers that can do so transfer all of them with a
+   single request.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_read_multiple (struct block *block, block_sector_t sector, size_t cnt,
+                     void *buffer)
+{
+  if (cnt > 0)
+    block_wait (block, false, sector, cnt, buffer);
+}
+
+/* Writes the CNT sectors starting at SECTOR to BLOCK from
+   BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+   Returns after the block device has acknowledged receiving all
+   of the data.  Drivers that can do so transfer all of it with a
+   single request.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_write_multiple (struct block *block, block_sector_t sector,
+                      size_t cnt, const void *buffer)
+{
+  if (cnt > 0)
+    block_wait (block, true, sector, cnt, (void *) buffer);
+}
+
+/* Returns true if request A_ is for a lower sector than B_. */
+static bool
+request_less (const struct list_elem *a_, const struct list_elem *b_,
+              void *aux UNUSED)
+{
+  const struct block_request *a
+    = list_entry (a_, struct block_request, sort_elem);
+  const struct block_request *b
+    = list_entry (b_, struct block_request, sort_elem);
+  return a->sector < b->sector;
+}
+
+/* Queues request R to BLOCK, and returns without waiting for it
+   to be served.  R->done is called once it has been, after which
+   R belongs to the caller again. */
+void
+block_submit (struct block *block, struct block_request *r)
+{
+  ASSERT (r->cnt > 0);
+  ASSERT (r->done != NULL);
+  check_sectors (block, r->sector, r->cnt);
+  ASSERT (!r->write || block->type != BLOCK_FOREIGN);
+
+  if (block->ops->submit != NULL)
+    {
+      /* Passed on to the device that serves it.  Submitters run
+         in different threads, so count with interrupts off. */
+      enum intr_level old_level = intr_disable ();
+      if (r->write)
+        block->write_cnt += r->cnt;
+      else
+        block->read_cnt += r->cnt;
+      intr_set_level (old_level);
+
+      block->ops->submit (block->aux, r);
+      return;
+    }
+
+  r->deadline = timer_ticks () + (r->write ? WRITE_EXPIRE : READ_EXPIRE);
+  r->tid = thread_tid ();
+
+  lock_acquire (&block->queue_lock);
+  block->depth_cnt[block->pending_cnt < DEPTH_BUCKETS
+                   ? block->pending_cnt : DEPTH_BUCKETS - 1]++;
+  block->pending_cnt++;
+  r->submitted = rdtsc ();
+  list_insert_ordered (&block->queue, &r->sort_elem, request_less, NULL);
+  list_push_back (&block->fifo, &r->fifo_elem);
+  condvar_signal (&block->queue_ready, &block->queue_lock);
+  lock_release (&block->queue_lock);
+}
+
+/* Completion function for block_wait(). */
+static void
+wake_up (struct block_request *r)
+{
+  semaphore_up (r->aux);
+}
+
+/* Submits a request to BLOCK to read or write the CNT sectors
+   starting at SECTOR to or from BUFFER, and waits for it to be
+   served. */
+static void
+block_wait (struct block *block, bool write, block_sector_t sector,
+            size_t cnt, void *buffer)
+{
+  struct block_request r;
+  struct semaphore done;
+
+  semaphore_init (&done, 0);
+  r.write = write;
+  r.sector = sector;
+  r.cnt = cnt;
+  r.buffer = buffer;
+  r.done = wake_up;
+  r.aux = &done;
+  block_submit (block, &r);
+  semaphore_down (&done);
+}
+
+/* Returns the request that BLOCK should serve next: the oldest
+   one if it is past its deadline, otherwise the next one in
+   C-LOOK order.  BLOCK's queue must not be empty. */
+static struct block_request *
+pick_request (struct block *block)
+{
+  struct block_request *oldest
+    = list_entry (list_front (&block->fifo), struct block_request, fifo_elem);
+  struct list_elem *e;
+
+  if (timer_ticks () >= oldest->deadline)
+    return oldest;
+
+  for (e = list_begin (&block->queue); e != list_end (&block->queue);
+       e = list_next (e))
+    {
+      struct block_request *r = list_entry (e, struct block_request,
+                                            sort_elem);
+      if (r->sector >= block->head)
+        return r;
+    }
+  return list_entry (list_front (&block->queue), struct block_request,
+                     sort_elem);
+}
+
+/* Moves the request that BLOCK should serve next, together with
+   the pending requests that can be merged with it, from BLOCK's
+   queue into BATCH in ascending sector order.  Returns the total
+   number of sectors.  BLOCK's queue must not be empty. */
+static size_t
+take_batch (struct block *block, struct list *batch)
+{
+  struct block_request *first = pick_request (block);
+  struct list_elem *e = list_next (&first->sort_elem);
+  block_sector_t end = first->sector + first->cnt;
+  size_t cnt = first->cnt;
+
+  list_remove (&first->sort_elem);
+  list_remove (&first->fifo_elem);
+  list_push_back (batch, &first->sort_elem);
+
+  /* Requests that continue where the batch ends.  Merged
+     requests go through BLOCK's merge buffer. */
+  while (block->merge_buf != NULL && e != list_end (&block->queue))
+    {
+      struct block_request *r = list_entry (e, struct block_request,
+                                            sort_elem);
+      if (r->sector != end || r->write != first->write
+          || cnt + r->cnt > MERGE_SECTORS)
+        break;
+
+      e = list_next (e);
+      list_remove (&r->sort_elem);
+      list_remove (&r->fifo_elem);
+      list_push_back (batch, &r->sort_elem);
+      end += r->cnt;
+      cnt += r->cnt;
+    }
+
+  block->head = end;
+  return cnt;
+}
+
+/* Has BLOCK's driver transfer the CNT sectors starting at SECTOR
+   to or from BUFFER. */
+static void
+transfer (struct block *block, bool write, block_sector_t sector,
+          size_t cnt, uint8_t *buffer)
+{
+  size_t i;
+
+  if (write)
+    {
+      if (block->ops->write_multiple != NULL)
+        block->ops->write_multiple (block->aux, sector, cnt, buffer);
+      else
+        for (i = 0; i < cnt; i++)
+          block->ops->write (block->aux, sector + i,
+                             buffer + i * BLOCK_SECTOR_SIZE);
+      block->write_cnt += cnt;
+    }
+  else
+    {
+      if (block->ops->read_multiple != NULL)
+        block->ops->read_multiple (block->aux, sector, cnt, buffer);
+      else
+        for (i = 0; i < cnt; i++)
+          block->ops->read (block->aux, sector + i,
+                            buffer + i * BLOCK_SECTOR_SIZE);
+      block->read_cnt += cnt;
+    }
+}
+
+/* Returns the latency bucket for a request that took CYCLES. */
+static int
+latency_bucket (uint64_t cycles)
+{
+  int bucket = 0;
+
+  while (cycles > 1 && bucket < LATENCY_BUCKETS - 1)
+    {
+      cycles >>= 1;
+      bucket++;
+    }
+  return bucket;
+}
+
+/* Accounts for request R to BLOCK having been served, taking
+   CYCLES since it was submitted. */
+static void
+record_request (struct block *block, const struct block_request *r,
+                uint64_t cycles)
+{
+  block->latency_cnt[r->write][latency_bucket (cycles)]++;
+
+  if (trace_enabled)
+    {
+      enum intr_level old_level = intr_disable ();
+      struct trace_entry *t = &trace[trace_cnt++ % TRACE_SIZE];
+      t->block = block;
+      t->sector = r->sector;
+      t->cnt = r->cnt;
+      t->write = r->write;
+      t->tid = r->tid;
+      t->latency = cycles;
+      intr_set_level (old_level);
+    }
+}
+
+/* Serves the requests in BATCH, which cover CNT consecutive
+   sectors, with a single transfer, and then completes them. */
+static void
+serve_batch (struct block *block, struct list *batch, size_t cnt)
+{
+  struct block_request *first
+    = list_entry (list_front (batch), struct block_request, sort_elem);
+  struct list_elem *e;
+  uint64_t now;
+  uint8_t *p;
+
+  if (list_front (batch) == list_back (batch))
+    transfer (block, first->write, first->sector, cnt, first->buffer);
+  else if (first->write)
+    {
+      p = block->merge_buf;
+      for (e = list_begin (batch); e != list_end (batch); e = list_next (e))
+        {
+          struct block_request *r = list_entry (e, struct block_request,
+                                                sort_elem);
+          memcpy (p, r->buffer, r->cnt * BLOCK_SECTOR_SIZE);
+          p += r->cnt * BLOCK_SECTOR_SIZE;
+        }
+      transfer (block, true, first->sector, cnt, block->merge_buf);
+    }
+  else
+    {
+      transfer (block, false, first->sector, cnt, block->merge_buf);
+      p = block->merge_buf;
+      for (e = list_begin (batch); e != list_end (batch); e = list_next (e))
+        {
+          struct block_request *r = list_entry (e, struct block_request,
+                                                sort_elem);
+          memcpy (r->buffer, p, r->cnt * BLOCK_SECTOR_SIZE);
+          p += r->cnt * BLOCK_SECTOR_SIZE;
+        }
+    }
+
+  /* A request may be gone as soon as it is completed. */
+  now = rdtsc ();
+  while (!list_empty (batch))
+    {
+      struct block_request *r = list_entry (list_pop_front (batch),
+                                            struct block_request, sort_elem);
+      record_request (block, r, now - r->submitted);
+      r->done (r);
+    }
+}
+
+/* A block device's thread: serves the requests in its queue. */
+static void
+block_worker (void *block_)
+{
+  struct block *block = block_;
+  size_t served = 0;
+
+  for (;;)
+    {
+      struct list batch;
+      size_t cnt;
+
+      list_init (&batch);
+      lock_acquire (&block->queue_lock);
+      block->pending_cnt -= served;
+      while (list_empty (&block->queue))
+        condvar_wait (&block->queue_ready, &block->queue_lock);
+      cnt = take_batch (block, &batch);
+      served = list_size (&batch);
+      lock_release (&block->queue_lock);
+
+      serve_batch (block, &batch, cnt);
+    }
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -160,22 +557,117 @@ block_type (struct block *block)
   return block->type;
 }
 
-/* Prints statistics for each block device used for a Pintos role. */
+/* Prints BLOCK's histogram of latencies for reads, if WRITE is
+   false, or writes, if WRITE is true. */
+static void
+print_latencies (struct block *block, bool write)
+{
+  int i;
+
+  printf ("  %s latency (cycles):", write ? "write" : "read");
+  for (i = 0; i < LATENCY_BUCKETS; i++)
+    if (block->latency_cnt[write][i] > 0)
+      printf (" 2^%d: %llu", i, block->latency_cnt[write][i]);
+  printf ("\n");
+}
+
+/* Prints the histogram of queue depths seen by requests to BLOCK
+   when they were submitted. */
+static void
+print_depths (struct block *block)
+{
+  int i;
+
+  printf ("  queue depth at submission:");
+  for (i = 0; i < DEPTH_BUCKETS; i++)
+    if (block->depth_cnt[i] > 0)
+      printf (" %d%s: %llu", i, i == DEPTH_BUCKETS - 1 ? "+" : "",
+              block->depth_cnt[i]);
+  printf ("\n");
+}
+
+/* Prints the trace of the most recent requests, oldest first. */
+static void
+print_trace (void)
+{
+  unsigned long long i;
+
+  printf ("Block request trace (last %llu of %llu):\n",
+          trace_cnt < TRACE_SIZE ? trace_cnt : TRACE_SIZE, trace_cnt);
+  for (i = trace_cnt < TRACE_SIZE ? 0 : trace_cnt - TRACE_SIZE;
+       i < trace_cnt; i++)
+    {
+      struct trace_entry *t = &trace[i % TRACE_SIZE];
+      printf ("  %s %s %"PRDSNu"+%"PRIu32" tid %d: %"PRIu64" cycles\n",
+              t->block->name, t->write ? "write" : "read",
+              t->sector, t->cnt, t->tid, t->latency);
+    }
+}
+
+/* Returns true if BLOCK is used for a Pintos role. */
+static bool
+has_role (const struct block *block)
+{
+  int i;
+
+  for (i = 0; i < BLOCK_ROLE_CNT; i++)
+    if (block_by_role[i] == block)
+      return true;
+  return false;
+}
+
+/* Prints BLOCK's statistics, including those of its request queue
+   if it has one. */
+static void
+print_block_stats (struct block *block)
+{
+  printf ("%s (%s): %llu reads, %llu writes\n",
+          block->name, block_type_name (block->type),
+          block->read_cnt, block->write_cnt);
+  printf ("  %llu bytes read, %llu bytes written\n",
+          block->read_cnt * BLOCK_SECTOR_SIZE,
+          block->write_cnt * BLOCK_SECTOR_SIZE);
+  if (block->ops->submit == NULL)
+    {
+      print_latencies (block, false);
+      print_latencies (block, true);
+      print_depths (block);
+    }
+}
+
+/* Prints statistics for each block device used for a Pintos role,
+   then for each other device whose request queue has been used,
+   such as the disks that the role partitions are on, and then the
+   request trace if it is enabled. */
 void
 block_print_stats (void)
 {
+  struct list_elem *e;
   int i;
 
   for (i = 0; i < BLOCK_ROLE_CNT; i++)
+    if (block_by_role[i] != NULL)
+      print_block_stats (block_by_role[i]);
+
+  for (e = list_begin (&all_blocks); e != list_end (&all_blocks);
+       e = list_next (e))
     {
-      struct block *block = block_by_role[i];
-      if (block != NULL)
-        {
-          printf ("%s (%s): %llu reads, %llu writes\n",
-                  block->name, block_type_name (block->type),
-                  block->read_cnt, block->write_cnt);
-        }
+      struct block *block = list_entry (e, struct block, list_elem);
+      if (block->ops->submit == NULL && !has_role (block)
+          && block->read_cnt + block->write_cnt > 0)
+        print_block_stats (block);
     }
+
+  if (trace_enabled)
+    print_trace ();
+}
+
+/* Starts recording the most recent block requests, to be printed
+   by block_print_stats(). */
+void
+block_trace_enable (void)
+{
+  trace_enabled = true;
 }
 
 /* Registers a new block device with the given NAME.  If
@@ -201,6 +693,23 @@ block_register (const char *name, enum block_type type,
   block->read_cnt = 0;
   block->write_cnt = 0;
 
+  lock_init (&block->queue_lock);
+  condvar_init (&block->queue_ready);
+  list_init (&block->queue);
+  list_init (&block->fifo);
+  block->head = 0;
+  block->pending_cnt = 0;
+  memset (block->depth_cnt, 0, sizeof block->depth_cnt);
+  memset (block->latency_cnt, 0, sizeof block->latency_cnt);
+  block->merge_buf = NULL;
+  if (ops->submit == NULL)
+    {
+      block->merge_buf = palloc_get_multiple (0, MERGE_PAGES);
+      if (thread_create (block->name, PRI_MAX, block_worker, block)
+          == TID_ERROR)
+        PANIC ("Failed to start thread for block device %s", block->name);
+    }
+
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
   printf (")");
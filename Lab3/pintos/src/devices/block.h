@@ -1,6 +1,8 @@
 #ifndef DEVICES_BLOCK_H
 #define DEVICES_BLOCK_H
 
+#include <list.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <inttypes.h>
 
@@ -53,11 +55,60 @@ struct block *block_next (struct block *);
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_read_multiple (struct block *, block_sector_t, size_t cnt, void *);
+void block_write_multiple (struct block *, block_sector_t, size_t cnt,
+                           const void *);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
 
+/* Asynchronous requests.
+
+   A request is queued with block_submit(), which returns right
+   away.  Each device serves its queue in a thread of its own,
+   one request at a time, in C-LOOK order: by ascending sector,
+   starting from where the previous request left off, and going
+   back to the lowest sector when there are none further on.  A
+   request that has waited past its deadline, though, is served
+   next regardless, so that requests far from the others are not
+   starved.  Pending requests in the same direction for adjacent
+   sectors are merged into a single transfer.
+
+   Requests for overlapping sectors that are pending at the same
+   time may be served in either order.
+
+   A partition has no queue of its own: its requests go straight
+   to the queue of the disk that it is part of. */
+
+struct block_request;
+
+/* Called, in the device's thread, when request R is done.  Must
+   not wait for other requests to the same device. */
+typedef void block_done_func (struct block_request *r);
+
+struct block_request
+  {
+    /* Set by the submitter.  SECTOR is changed to the sector on
+       the underlying disk when the request is to a partition. */
+    bool write;                 /* Write, rather than read? */
+    block_sector_t sector;      /* First sector. */
+    size_t cnt;                 /* Number of sectors. */
+    void *buffer;               /* CNT * BLOCK_SECTOR_SIZE bytes. */
+    block_done_func *done;      /* Called when done. */
+    void *aux;                  /* For use by DONE. */
+
+    /* Owned by the block layer until DONE is called. */
+    struct list_elem sort_elem; /* Element in the queue, by sector. */
+    struct list_elem fifo_elem; /* Element in the queue, by age. */
+    int64_t deadline;           /* Timer tick to serve it by. */
+    uint64_t submitted;         /* Time-stamp counter at submission. */
+    int tid;                    /* Submitting thread. */
+  };
+
+void block_submit (struct block *, struct block_request *);
+
 /* Statistics. */
 void block_print_stats (void);
+void block_trace_enable (void);
 
 /* Lower-level interface to block device drivers. */
 
@@ -65,6 +116,21 @@ struct block_operations
   {
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+
+    /* Transfer CNT consecutive sectors at once.  Optional: if
+       null, the block layer calls `read' or `write' once per
+       sector instead. */
+    void (*read_multiple) (void *aux, block_sector_t, size_t cnt,
+                           void *buffer);
+    void (*write_multiple) (void *aux, block_sector_t, size_t cnt,
+                            const void *buffer);
+
+    /* Passes request R on to another device, such as the disk a
+       partition is part of, having translated R->sector.  R's
+       sectors have already been checked against this device.
+       Optional: if non-null, the device gets no request queue or
+       thread of its own, and the operations above are unused. */
+    void (*submit) (void *aux, struct block_request *r);
   };
 
 struct block *block_register (const char *name, enum block_type,
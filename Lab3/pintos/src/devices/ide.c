@@ -5,13 +5,20 @@
 #include <stdio.h>
 #include "devices/block.h"
 #include "devices/partition.h"
+#include "devices/pci.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
 #include "threads/lock.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
-   controller.  It attempts to comply to [ATA-3]. */
+   controller.  It attempts to comply to [ATA-3].
+
+   Data moves by bus-master DMA, as on the PIIX controllers that
+   QEMU and Bochs emulate, if the controller and the disk support
+   it.  Otherwise, and for IDENTIFY DEVICE, it moves by programmed
+   I/O through the data register. */
 
 /* ATA command block port addresses. */
 #define reg_data(CHANNEL) ((CHANNEL)->reg_base + 0)     /* Data. */
@@ -30,10 +37,24 @@
 #define reg_ctl(CHANNEL) ((CHANNEL)->reg_base + 0x206)  /* Control (w/o). */
 #define reg_alt_status(CHANNEL) reg_ctl (CHANNEL)       /* Alt Status (r/o). */
 
+/* Bus master port addresses. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)  /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)    /* PRD table. */
+
 /* Alternate Status Register bits. */
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
+
+/* Bus Master Command Register bits. */
+#define BM_CMD_START 0x01       /* Start the transfer. */
+#define BM_CMD_READ 0x08        /* Transfer from the disk to memory. */
+
+/* Bus Master Status Register bits. */
+#define BM_STA_ERR 0x02         /* Error; write 1 to clear. */
+#define BM_STA_INTR 0x04        /* Interrupt; write 1 to clear. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -49,6 +70,36 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_DMA_RETRY 0xc8         /* READ DMA with retries. */
+#define CMD_WRITE_DMA_RETRY 0xca        /* WRITE DMA with retries. */
+
+/* Most sectors that one READ SECTOR or WRITE SECTOR command can
+   transfer.  A sector count of 0 in the command means this many. */
+#define MAX_SECTORS_PER_COMMAND 256
+
+/* PCI class and subclass of IDE controllers, and the bit in
+   their programming interface byte that says they can do
+   bus-master DMA. */
+#define PCI_CLASS_STORAGE 0x01
+#define PCI_SUBCLASS_IDE 0x01
+#define PCI_IDE_BUS_MASTER 0x80
+
+/* A physical region descriptor: one of the regions of memory
+   that a bus-master DMA transfer goes to or comes from.  A
+   region must not cross a 64 kB boundary. */
+struct prd
+  {
+    uint32_t addr;              /* Physical address. */
+    uint16_t size;              /* Size in bytes, with 0 meaning 64 kB. */
+    uint16_t flags;             /* PRD_EOT, on the last region. */
+  };
+
+#define PRD_EOT 0x8000          /* End of table. */
+
+/* Regions needed for the largest transfer: MAX_SECTORS_PER_COMMAND
+   sectors span two 64 kB blocks, and parts of one more on either
+   side. */
+#define PRD_CNT 4
 
 /* An ATA device. */
 struct ata_disk
@@ -57,6 +108,7 @@ struct ata_disk
     struct channel *channel;    /* Channel that disk is attached to. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
     bool is_ata;                /* Is device an ATA disk? */
+    bool dma;                   /* Does it support DMA? */
   };
 
 /* An ATA channel (aka controller).
@@ -72,6 +124,16 @@ struct channel
                                    any interrupt would be spurious. */
     struct semaphore completion_wait;   /* Up'd by interrupt handler. */
 
+    uint16_t bm_base;           /* Bus master base I/O port, or 0 if the
+                                   controller cannot do DMA. */
+    struct prd *prdt;           /* PRD table for DMA transfers. */
+
+    bool busy;                  /* Transfer in progress? */
+    unsigned long long transfer_cnt;    /* Number of transfers. */
+    unsigned long long overlap_cnt;     /* Number of transfers started
+                                           while another channel was
+                                           busy. */
+
     struct ata_disk devices[2];     /* The devices on this channel. */
   };
 
@@ -79,14 +141,25 @@ struct channel
 #define CHANNEL_CNT 2
 static struct channel channels[CHANNEL_CNT];
 
+/* PRD table of each channel.  The alignment keeps each table
+   within a 64 kB block, as the controller requires. */
+static struct prd prd_tables[CHANNEL_CNT][PRD_CNT]
+  __attribute__ ((aligned (PRD_CNT * sizeof (struct prd))));
+
+/* Whether to transfer data by DMA when the disk supports it. */
+static bool use_dma;
+
 static struct block_operations ide_operations;
 
 static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
 
-static void select_sector (struct ata_disk *, block_sector_t);
-static void issue_pio_command (struct channel *, uint8_t command);
+static uint16_t find_bus_master (void);
+static void select_sector (struct ata_disk *, block_sector_t, size_t cnt);
+static void issue_command (struct channel *, uint8_t command);
+static bool dma_transfer (struct ata_disk *, block_sector_t, size_t cnt,
+                          const void *buffer, bool write);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
 
@@ -94,6 +167,7 @@ static void wait_until_idle (const struct ata_disk *);
 static bool wait_while_busy (const struct ata_disk *);
 static void select_device (const struct ata_disk *);
 static void select_device_wait (const struct ata_disk *);
+static void begin_transfer (struct channel *);
 
 static void interrupt_handler (struct intr_frame *);
 
@@ -101,6 +175,7 @@ static void interrupt_handler (struct intr_frame *);
 void
 ide_init (void) 
 {
+  uint16_t bm_base = find_bus_master ();
   size_t chan_no;
 
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
@@ -126,6 +201,10 @@ ide_init (void)
       lock_init (&c->lock);
       c->expecting_interrupt = false;
       semaphore_init (&c->completion_wait, 0);
+      c->bm_base = bm_base != 0 ? bm_base + chan_no * 8 : 0;
+      c->prdt = prd_tables[chan_no];
+      c->busy = false;
+      c->transfer_cnt = c->overlap_cnt = 0;
  
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -136,6 +215,7 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->dma = false;
         }
 
       /* Register interrupt handler. */
@@ -153,6 +233,66 @@ ide_init (void)
         if (c->devices[dev_no].is_ata)
           identify_ata_device (&c->devices[dev_no]);
     }
+
+  use_dma = bm_base != 0;
+}
+
+/* Prints statistics for each channel that has been used.
+
+   Requests are queued and dispatched per disk, by the block layer,
+   and partitions feed their disk's queue directly.  A disk's thread
+   holds its channel's lock only while a transfer is in progress, so
+   the two channels transfer at the same time whenever both have
+   work.  The two disks on one channel take turns: the channel can
+   run only one command at a time, whichever disk it is for.  The
+   statistics show how often transfers on the two channels
+   overlapped. */
+void
+ide_print_stats (void)
+{
+  struct channel *c;
+
+  for (c = channels; c < channels + CHANNEL_CNT; c++)
+    if (c->transfer_cnt > 0)
+      printf ("%s: %llu transfers, %llu while another channel was busy\n",
+              c->name, c->transfer_cnt, c->overlap_cnt);
+}
+
+/* Transfers data by DMA from now on if ENABLE is true and DMA is
+   available, and by programmed I/O otherwise.  Returns true if
+   DMA will be used.  DMA is used by default wherever possible. */
+bool
+ide_set_dma (bool enable)
+{
+  use_dma = enable && channels[0].bm_base != 0;
+  return use_dma;
+}
+
+/* Looks for an IDE controller that can do bus-master DMA on the
+   PCI bus.  If there is one, enables it as a bus master and
+   returns its bus master base I/O port, which is followed by the
+   8 ports of the first channel and then those of the second.
+   Otherwise, returns 0. */
+static uint16_t
+find_bus_master (void)
+{
+  struct pci_function f;
+  uint32_t bar;
+
+  if (!pci_find_class (PCI_CLASS_STORAGE, PCI_SUBCLASS_IDE, &f)
+      || !((pci_read_config (f, PCI_REG_CLASS) >> 8) & PCI_IDE_BUS_MASTER))
+    return 0;
+
+  /* The bus master registers are in I/O space, at BAR 4. */
+  bar = pci_read_config (f, PCI_REG_BAR (4));
+  if (!(bar & 1) || (bar & 0xfffc) == 0)
+    return 0;
+
+  pci_write_config (f, PCI_REG_COMMAND,
+                    pci_read_config (f, PCI_REG_COMMAND)
+                    | PCI_COMMAND_IO | PCI_COMMAND_MASTER);
+  printf ("ide: bus-master DMA at port %#x\n", bar & 0xfffc);
+  return bar & 0xfffc;
 }
 
 /* Disk detection and identification. */
@@ -272,7 +412,7 @@ identify_ata_device (struct ata_disk *d)
      indicating the device's response is ready, and read the data
      into our buffer. */
   select_device_wait (d);
-  issue_pio_command (c, CMD_IDENTIFY_DEVICE);
+  issue_command (c, CMD_IDENTIFY_DEVICE);
   semaphore_down (&c->completion_wait);
   if (!wait_while_busy (d))
     {
@@ -284,6 +424,7 @@ identify_ata_device (struct ata_disk *d)
   /* Calculate capacity.
      Read model name and serial number. */
   capacity = *(uint32_t *) &id[60 * 2];
+  d->dma = c->bm_base != 0 && (*(uint16_t *) &id[49 * 2] & 0x0100) != 0;
   model = descramble_ata_string (&id[10 * 2], 20);
   serial = descramble_ata_string (&id[27 * 2], 40);
   snprintf (extra_info, sizeof extra_info,
@@ -337,63 +478,157 @@ descramble_ata_string (char *string, int size)
   return string;
 }
 
-/* Reads sector SEC_NO from disk D into BUFFER, which must have
-   room for BLOCK_SECTOR_SIZE bytes.
+/* Returns true if a transfer between disk D and BUFFER can be
+   done by DMA. */
+static bool
+can_dma (const struct ata_disk *d, const void *buffer)
+{
+  return (use_dma && d->dma
+          && is_kernel_vaddr (buffer) && (uintptr_t) buffer % 2 == 0);
+}
+
+/* Reads the CNT sectors starting at SEC_NO from disk D into
+   BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE bytes.
+   Each command covers up to MAX_SECTORS_PER_COMMAND sectors, so
+   that the device is selected and the command issued once for all
+   of them.  Under programmed I/O the disk still interrupts once
+   per sector, when that sector's data is ready; under DMA, once
+   when all of them are in memory.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
-ide_read (void *d_, block_sector_t sec_no, void *buffer)
+ide_read_multiple (void *d_, block_sector_t sec_no, size_t cnt, void *buffer_)
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
+  uint8_t *buffer = buffer_;
+
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  semaphore_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
+  begin_transfer (c);
+  while (cnt > 0)
+    {
+      size_t n = cnt < MAX_SECTORS_PER_COMMAND ? cnt : MAX_SECTORS_PER_COMMAND;
+      size_t i;
+
+      if (can_dma (d, buffer))
+        {
+          if (!dma_transfer (d, sec_no, n, buffer, false))
+            PANIC ("%s: disk read failed, sectors=%"PRDSNu"+%zu",
+                   d->name, sec_no, n);
+          buffer += n * BLOCK_SECTOR_SIZE;
+        }
+      else
+        {
+          select_sector (d, sec_no, n);
+          issue_command (c, CMD_READ_SECTOR_RETRY);
+          for (i = 0; i < n; i++)
+            {
+              semaphore_down (&c->completion_wait);
+              if (!wait_while_busy (d))
+                PANIC ("%s: disk read failed, sector=%"PRDSNu,
+                       d->name, sec_no + i);
+              input_sector (c, buffer);
+              buffer += BLOCK_SECTOR_SIZE;
+            }
+        }
+      sec_no += n;
+      cnt -= n;
+    }
+  c->busy = false;
   lock_release (&c->lock);
 }
 
-/* Write sector SEC_NO to disk D from BUFFER, which must contain
-   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
-   acknowledged receiving the data.
+/* Writes the CNT sectors starting at SEC_NO to disk D from
+   BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+   Returns after the disk has acknowledged receiving all of the
+   data.  As in ide_read_multiple(), one command covers up to
+   MAX_SECTORS_PER_COMMAND sectors, and the disk interrupts once
+   it has taken each sector, or all of them under DMA.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
-ide_write (void *d_, block_sector_t sec_no, const void *buffer)
+ide_write_multiple (void *d_, block_sector_t sec_no, size_t cnt,
+                    const void *buffer_)
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
+  const uint8_t *buffer = buffer_;
+
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  semaphore_down (&c->completion_wait);
+  begin_transfer (c);
+  while (cnt > 0)
+    {
+      size_t n = cnt < MAX_SECTORS_PER_COMMAND ? cnt : MAX_SECTORS_PER_COMMAND;
+      size_t i;
+
+      if (can_dma (d, buffer))
+        {
+          if (!dma_transfer (d, sec_no, n, buffer, true))
+            PANIC ("%s: disk write failed, sectors=%"PRDSNu"+%zu",
+                   d->name, sec_no, n);
+          buffer += n * BLOCK_SECTOR_SIZE;
+        }
+      else
+        {
+          select_sector (d, sec_no, n);
+          issue_command (c, CMD_WRITE_SECTOR_RETRY);
+          for (i = 0; i < n; i++)
+            {
+              if (!wait_while_busy (d))
+                PANIC ("%s: disk write failed, sector=%"PRDSNu,
+                       d->name, sec_no + i);
+              output_sector (c, buffer);
+              buffer += BLOCK_SECTOR_SIZE;
+              semaphore_down (&c->completion_wait);
+            }
+        }
+      sec_no += n;
+      cnt -= n;
+    }
+  c->busy = false;
   lock_release (&c->lock);
 }
 
+/* Reads sector SEC_NO from disk D into BUFFER, which must have
+   room for BLOCK_SECTOR_SIZE bytes. */
+static void
+ide_read (void *d, block_sector_t sec_no, void *buffer)
+{
+  ide_read_multiple (d, sec_no, 1, buffer);
+}
+
+/* Write sector SEC_NO to disk D from BUFFER, which must contain
+   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
+   acknowledged receiving the data. */
+static void
+ide_write (void *d, block_sector_t sec_no, const void *buffer)
+{
+  ide_write_multiple (d, sec_no, 1, buffer);
+}
+
 static struct block_operations ide_operations =
   {
     ide_read,
-    ide_write
+    ide_write,
+    ide_read_multiple,
+    ide_write_multiple,
+    NULL
   };
-
+
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and the count CNT of sectors to transfer, at
+   most MAX_SECTORS_PER_COMMAND, to the disk's sector selection
+   registers.  (We use LBA mode.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sector (struct ata_disk *d, block_sector_t sec_no, size_t cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt > 0 && cnt <= MAX_SECTORS_PER_COMMAND);
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt % MAX_SECTORS_PER_COMMAND);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -404,7 +639,7 @@ select_sector (struct ata_disk *d, block_sector_t sec_no)
 /* Writes COMMAND to channel C and prepares for receiving a
    completion interrupt. */
 static void
-issue_pio_command (struct channel *c, uint8_t command) 
+issue_command (struct channel *c, uint8_t command) 
 {
   /* Interrupts must be enabled or our semaphore will never be
      up'd by the completion handler. */
@@ -414,6 +649,69 @@ issue_pio_command (struct channel *c, uint8_t command)
   outb (reg_command (c), command);
 }
 
+/* Fills in channel C's PRD table to describe the SIZE bytes at
+   BUFFER, which must be in the kernel's mapping of physical
+   memory, so that they are physically contiguous too. */
+static void
+build_prd_table (struct channel *c, const void *buffer, size_t size)
+{
+  uintptr_t addr = vtop (buffer);
+  struct prd *prd = c->prdt;
+
+  ASSERT (size > 0);
+  while (size > 0)
+    {
+      size_t chunk = 0x10000 - (addr & 0xffff);
+      if (chunk > size)
+        chunk = size;
+
+      ASSERT (prd < c->prdt + PRD_CNT);
+      prd->addr = addr;
+      prd->size = chunk;
+      prd->flags = 0;
+      prd++;
+
+      addr += chunk;
+      size -= chunk;
+    }
+  prd[-1].flags = PRD_EOT;
+}
+
+/* Transfers the CNT sectors starting at SEC_NO, at most
+   MAX_SECTORS_PER_COMMAND of them, between disk D and BUFFER by
+   bus-master DMA: from BUFFER to the disk if WRITE is true, from
+   the disk into BUFFER otherwise.  The calling thread sleeps
+   until the transfer is done.  Returns true if successful, false
+   on error.  Must be called with D's channel locked. */
+static bool
+dma_transfer (struct ata_disk *d, block_sector_t sec_no, size_t cnt,
+              const void *buffer, bool write)
+{
+  struct channel *c = d->channel;
+  uint8_t direction = write ? 0 : BM_CMD_READ;
+  uint8_t bm_status, status;
+
+  ASSERT (lock_held_by_current_thread (&c->lock));
+
+  build_prd_table (c, buffer, cnt * BLOCK_SECTOR_SIZE);
+  outl (reg_bm_prdt (c), vtop (c->prdt));
+  outb (reg_bm_command (c), direction);
+  outb (reg_bm_status (c),
+        inb (reg_bm_status (c)) | BM_STA_ERR | BM_STA_INTR);
+
+  select_sector (d, sec_no, cnt);
+  issue_command (c, write ? CMD_WRITE_DMA_RETRY : CMD_READ_DMA_RETRY);
+  outb (reg_bm_command (c), direction | BM_CMD_START);
+  semaphore_down (&c->completion_wait);
+
+  /* Stop the DMA engine, and clear its interrupt and error bits. */
+  bm_status = inb (reg_bm_status (c));
+  outb (reg_bm_command (c), direction);
+  outb (reg_bm_status (c), bm_status | BM_STA_ERR | BM_STA_INTR);
+  status = inb (reg_status (c));
+  return !(bm_status & BM_STA_ERR) && !(status & (STA_ERR | STA_BSY));
+}
+
 /* Reads a sector from channel C's data register in PIO mode into
    SECTOR, which must have room for BLOCK_SECTOR_SIZE bytes. */
 static void
@@ -492,6 +790,25 @@ select_device (const struct ata_disk *d)
   timer_nsleep (400);
 }
 
+/* Notes that a transfer is starting on channel C, whose lock must
+   be held. */
+static void
+begin_transfer (struct channel *c)
+{
+  struct channel *other;
+
+  ASSERT (lock_held_by_current_thread (&c->lock));
+
+  c->busy = true;
+  c->transfer_cnt++;
+  for (other = channels; other < channels + CHANNEL_CNT; other++)
+    if (other != c && other->busy)
+      {
+        c->overlap_cnt++;
+        break;
+      }
+}
+
 /* Select disk D in its channel, as select_device(), but wait for
    the channel to become idle before and after. */
 static void
@@ -0,0 +1,76 @@
+#include "devices/pci.h"
+#include "threads/io.h"
+
+/* This code accesses PCI configuration space through
+   configuration mechanism #1, which every PC chipset that Pintos
+   runs on, emulated or not, provides.  See [PCI] for details. */
+
+/* I/O port addresses. */
+#define PCI_CONFIG_ADDRESS 0xcf8  /* Selects the register to access. */
+#define PCI_CONFIG_DATA    0xcfc  /* Data of the selected register. */
+
+/* Returns the value to write to PCI_CONFIG_ADDRESS to select
+   register REG of function F. */
+static uint32_t
+config_address (struct pci_function f, uint8_t reg)
+{
+  return (0x80000000u | ((uint32_t) f.bus << 16) | ((uint32_t) f.dev << 11)
+          | ((uint32_t) f.func << 8) | (reg & 0xfc));
+}
+
+/* Reads the 32-bit configuration register at offset REG, which
+   must be a multiple of 4, of function F. */
+uint32_t
+pci_read_config (struct pci_function f, uint8_t reg)
+{
+  outl (PCI_CONFIG_ADDRESS, config_address (f, reg));
+  return inl (PCI_CONFIG_DATA);
+}
+
+/* Writes VALUE to the 32-bit configuration register at offset
+   REG, which must be a multiple of 4, of function F. */
+void
+pci_write_config (struct pci_function f, uint8_t reg, uint32_t value)
+{
+  outl (PCI_CONFIG_ADDRESS, config_address (f, reg));
+  outl (PCI_CONFIG_DATA, value);
+}
+
+/* Searches the PCI buses for a function of the given CLASS and
+   SUBCLASS.  If one is found, stores its location in *F and
+   returns true; otherwise, returns false. */
+bool
+pci_find_class (uint8_t class, uint8_t subclass, struct pci_function *f)
+{
+  unsigned bus, dev, func;
+
+  for (bus = 0; bus < 256; bus++)
+    for (dev = 0; dev < 32; dev++)
+      for (func = 0; func < 8; func++)
+        {
+          struct pci_function cand = { bus, dev, func };
+          uint32_t class_reg;
+
+          /* A vendor ID of all 1s means nothing is there. */
+          if ((pci_read_config (cand, PCI_REG_ID) & 0xffff) == 0xffff)
+            {
+              if (func == 0)
+                break;
+              continue;
+            }
+
+          class_reg = pci_read_config (cand, PCI_REG_CLASS);
+          if ((class_reg >> 24) == class
+              && ((class_reg >> 16) & 0xff) == subclass)
+            {
+              *f = cand;
+              return true;
+            }
+
+          /* Only multi-function devices have functions past 0. */
+          if (func == 0
+              && !(pci_read_config (cand, PCI_REG_HEADER) & 0x800000))
+            break;
+        }
+  return false;
+}
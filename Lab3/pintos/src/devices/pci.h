@@ -0,0 +1,32 @@
+#ifndef DEVICES_PCI_H
+#define DEVICES_PCI_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Location of a PCI function. */
+struct pci_function
+  {
+    uint8_t bus;                /* Bus number, 0...255. */
+    uint8_t dev;                /* Device number, 0...31. */
+    uint8_t func;               /* Function number, 0...7. */
+  };
+
+/* Offsets of configuration space registers common to every PCI
+   function. */
+#define PCI_REG_ID      0x00    /* Vendor ID, device ID. */
+#define PCI_REG_COMMAND 0x04    /* Command, status. */
+#define PCI_REG_CLASS   0x08    /* Revision, prog IF, subclass, class. */
+#define PCI_REG_HEADER  0x0c    /* Header type, among others. */
+#define PCI_REG_BAR(N)  (0x10 + 4 * (N))  /* Base address register N. */
+
+/* Command register bits. */
+#define PCI_COMMAND_IO     0x0001  /* Respond to I/O space accesses. */
+#define PCI_COMMAND_MASTER 0x0004  /* May act as a bus master. */
+
+uint32_t pci_read_config (struct pci_function, uint8_t reg);
+void pci_write_config (struct pci_function, uint8_t reg, uint32_t);
+bool pci_find_class (uint8_t class, uint8_t subclass,
+                     struct pci_function *);
+
+#endif /* devices/pci.h */
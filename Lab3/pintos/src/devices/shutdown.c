@@ -11,6 +11,8 @@
 #endif
 #ifdef FILESYS
 #include "devices/block.h"
+#include "devices/ide.h"
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #endif
 
@@ -129,6 +131,8 @@ print_stats (void)
   thread_print_stats ();
 #ifdef FILESYS
   block_print_stats ();
+  ide_print_stats ();
+  buffer_cache_print_stats ();
 #endif
   console_print_stats ();
   kbd_print_stats ();
@@ -1,179 +1,820 @@
 #include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "filesys/cache.h"
 #include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "devices/timer.h"
+#include "threads/condvar.h"
 #include "threads/lock.h"
+#include "threads/semaphore.h"
+#include "threads/thread.h"
 
 #define BUFFER_CACHE_SIZE 64
 
+/* Number of shards the sector index is split into.  Each shard has
+   its own lock, so lookups of sectors in different shards never
+   contend. */
+#define BUFFER_CACHE_SHARDS 8
+
+/* The write-behind thread wakes up every FLUSH_INTERVAL ticks,
+   and writes back the entries that have been dirty for at least
+   FLUSH_AGE ticks. */
+#define FLUSH_INTERVAL (TIMER_FREQ / 2)
+#define FLUSH_AGE TIMER_FREQ
+
+/* Replacement follows the 2Q algorithm (Johnson and Shasha).  A
+   sector read in for the first time goes on `a1in', a FIFO queue,
+   and is evicted from there unless it is referenced again after it
+   has dropped off: `a1out' remembers the sectors last evicted from
+   `a1in', and a miss on one of them puts the sector on `am', where
+   it is replaced in approximate LRU order by the clock algorithm.
+   A long sequential read thus only ever cycles through `a1in',
+   leaving the sectors on `am' alone.
+
+   Metadata skips `a1in' and goes straight to `am', where it also
+   gets one more pass of the clock hand than file data does before
+   it is evicted. */
+
+/* Number of entries `a1in' may hold before it is preferred for
+   eviction over `am'. */
+#define A1IN_MAX (BUFFER_CACHE_SIZE / 4)
+
+/* Number of sectors remembered in `a1out'. */
+#define A1OUT_SIZE (BUFFER_CACHE_SIZE / 2)
+
+/* An a1out slot that remembers nothing. */
+#define A1OUT_EMPTY ((block_sector_t) -1)
+
 struct buffer_cache_entry_t {
-  bool occupied;  // true only if this entry is valid cache entry
+  struct hash_elem elem;  // element in its shard's sector index
+  bool occupied;  // true only if this entry is in a shard's index
+  bool busy;      // claimed, or disk I/O in flight: data not usable
+  int pin_cnt;    // number of buffer_cache_pin()s: may not be evicted
 
   block_sector_t disk_sector;
-  uint8_t buffer[BLOCK_SECTOR_SIZE];
+  uint8_t *buffer;
+  enum buffer_cache_class cls;  // what the sector holds
 
   bool dirty;     // dirty bit
-  bool access;    // reference bit, for clock algorithm
+  int64_t dirty_since;  // timer tick at which `dirty' was set
+  bool access;    // reference bit, for the clock on `am'
+
+  // replacement state, protected by queue_lock
+  struct list_elem queue_elem;  // element in free_slots, a1in or am
+  bool hot;       // on `am' rather than `a1in'
+  int chances;    // clock passes left before eviction from `am'
+
+  struct condvar io_done;  // signalled when `busy' clears
+
+  // asynchronous disk I/O, while busy
+  struct block_request io;
+  struct semaphore *io_wait;  // upped when `io' completes, or NULL
+};
+
+/* A shard of the sector index.  The lock protects the index and
+   every field, other than `buffer', of the entries in it.  It is
+   never held during disk I/O: an entry whose data is being read
+   or written back is marked busy instead, and threads that need
+   it wait on its io_done. */
+struct buffer_cache_shard_t {
+  struct lock lock;
+  struct hash index;    // disk_sector -> buffer_cache_entry_t
+
+  // statistics for the sectors in this shard
+  unsigned long long hit_cnt[CACHE_CLASS_CNT];
+  unsigned long long miss_cnt[CACHE_CLASS_CNT];
 };
 
-/* Buffer cache entries. */
+/* Buffer cache entries, and the sector data they hold. */
 static struct buffer_cache_entry_t cache[BUFFER_CACHE_SIZE];
+static uint8_t cache_data[BUFFER_CACHE_SIZE][BLOCK_SECTOR_SIZE];
+
+static struct buffer_cache_shard_t shards[BUFFER_CACHE_SHARDS];
+
+/* Protects the replacement queues below, and owns the entries
+   that are not in any shard's index.  Acquired before any shard
+   lock. */
+static struct lock queue_lock;
+static struct list free_slots;  // entries never used
+static struct list a1in;        // first referenced, oldest first
+static size_t a1in_cnt;
+static struct list am;          // referenced again, in clock order
+static size_t am_cnt;
+static block_sector_t a1out[A1OUT_SIZE];  // ring of evicted sectors
+static size_t a1out_next;
+static unsigned long long evict_cnt[CACHE_CLASS_CNT];
+
+static const char *class_names[CACHE_CLASS_CNT] = {
+  "data", "directory", "indirect", "inode",
+};
 
-/* A global lock for synchronizing buffer cache operations. */
-static struct lock buffer_cache_lock;
+/* Sectors waiting to be read ahead by the prefetch thread, as a
+   ring buffer.  Requests that do not fit are dropped: read-ahead
+   is only a hint. */
+#define PREFETCH_QUEUE_SIZE 64
+static block_sector_t prefetch_queue[PREFETCH_QUEUE_SIZE];
+static size_t prefetch_head, prefetch_cnt;
+static struct lock prefetch_lock;
+static struct condvar prefetch_ready;
+
+/* Read-ahead may have this many reads pending at once, leaving the
+   rest of the cache to everyone else. */
+#define PREFETCH_PENDING_MAX (BUFFER_CACHE_SIZE / 4)
+static struct semaphore prefetch_slots;
+
+static hash_hash_func buffer_cache_hash;
+static hash_less_func buffer_cache_less;
+static thread_func buffer_cache_prefetchd;
+static thread_func buffer_cache_flushd;
+
+static struct buffer_cache_shard_t *
+shard_of (block_sector_t sector)
+{
+  return &shards[sector % BUFFER_CACHE_SHARDS];
+}
 
 void
 buffer_cache_init (void)
 {
-  lock_init (&buffer_cache_lock);
+  static const char *shard_names[BUFFER_CACHE_SHARDS] = {
+    "cache_shard0", "cache_shard1", "cache_shard2", "cache_shard3",
+    "cache_shard4", "cache_shard5", "cache_shard6", "cache_shard7",
+  };
+  size_t i;
+
+  lock_init_adaptive (&queue_lock, "cache_queue");
+  list_init (&free_slots);
+  list_init (&a1in);
+  list_init (&am);
+  a1in_cnt = am_cnt = 0;
+  for (i = 0; i < A1OUT_SIZE; ++ i)
+    a1out[i] = A1OUT_EMPTY;
+  a1out_next = 0;
+
+  for (i = 0; i < BUFFER_CACHE_SHARDS; ++ i)
+  {
+    lock_init_adaptive (&shards[i].lock, shard_names[i]);
+    if (!hash_init (&shards[i].index,
+                    buffer_cache_hash, buffer_cache_less, NULL))
+      PANIC ("buffer cache: out of memory");
+  }
 
   // initialize entries
-  size_t i;
   for (i = 0; i < BUFFER_CACHE_SIZE; ++ i)
   {
     cache[i].occupied = false;
+    cache[i].busy = false;
+    cache[i].pin_cnt = 0;
+    cache[i].buffer = cache_data[i];
+    condvar_init (&cache[i].io_done);
+    list_push_back (&free_slots, &cache[i].queue_elem);
+  }
+
+  lock_init (&prefetch_lock);
+  condvar_init (&prefetch_ready);
+  prefetch_head = prefetch_cnt = 0;
+  semaphore_init (&prefetch_slots, PREFETCH_PENDING_MAX);
+  thread_create ("prefetchd", PRI_DEFAULT, buffer_cache_prefetchd, NULL);
+  thread_create ("flushd", PRI_DEFAULT, buffer_cache_flushd, NULL);
+}
+
+/**
+ * Looks SECTOR up in SHARD's index, and returns its entry,
+ * or NULL in case of cache miss.
+ * Must be called with the shard's lock held.
+ */
+static struct buffer_cache_entry_t*
+buffer_cache_lookup (struct buffer_cache_shard_t *shard, block_sector_t sector)
+{
+  ASSERT (lock_held_by_current_thread (&shard->lock));
+
+  struct buffer_cache_entry_t key;
+  key.disk_sector = sector;
+
+  struct hash_elem *e = hash_find (&shard->index, &key.elem);
+  return e != NULL ? hash_entry (e, struct buffer_cache_entry_t, elem) : NULL;
+}
+
+/**
+ * Marks ENTRY as modified since it was last written back.
+ * Must be called with the entry's shard lock held.
+ */
+static void
+buffer_cache_mark_dirty (struct buffer_cache_entry_t *entry)
+{
+  if (!entry->dirty) {
+    entry->dirty = true;
+    entry->dirty_since = timer_ticks ();
   }
 }
 
 /**
- * An internal method for flushing back the cache entry into disk.
- * Must be called with the lock held.
+ * Marks ENTRY, which is in SHARD, no longer busy, and wakes up
+ * everyone waiting for it.
  */
 static void
-buffer_cache_flush (struct buffer_cache_entry_t *entry)
+buffer_cache_unbusy (struct buffer_cache_shard_t *shard,
+                     struct buffer_cache_entry_t *entry)
 {
-  ASSERT (lock_held_by_current_thread(&buffer_cache_lock));
-  ASSERT (entry != NULL && entry->occupied == true);
+  ASSERT (lock_held_by_current_thread (&shard->lock));
+  ASSERT (entry->busy);
+
+  entry->busy = false;
+  condvar_broadcast (&entry->io_done, &shard->lock);
+}
 
-  if (entry->dirty) {
-    block_write (fs_device, entry->disk_sector, entry->buffer);
+/**
+ * Completion function for the asynchronous disk I/O of an entry:
+ * makes the entry usable again.
+ */
+static void
+buffer_cache_io_done (struct block_request *r)
+{
+  struct buffer_cache_entry_t *entry = r->aux;
+  struct buffer_cache_shard_t *shard = shard_of (entry->disk_sector);
+  struct semaphore *wait = entry->io_wait;
+
+  lock_acquire (&shard->lock);
+  buffer_cache_unbusy (shard, entry);
+  lock_release (&shard->lock);
+  if (wait != NULL)
+    semaphore_up (wait);
+}
+
+/**
+ * Queues a read or write of busy ENTRY's sector, and returns without
+ * waiting for it. The entry stops being busy when it is done, and
+ * then WAIT, unless NULL, is upped.
+ */
+static void
+buffer_cache_submit (struct buffer_cache_entry_t *entry, bool write,
+                     struct semaphore *wait)
+{
+  ASSERT (entry->busy);
+
+  entry->io_wait = wait;
+  entry->io.write = write;
+  entry->io.sector = entry->disk_sector;
+  entry->io.cnt = 1;
+  entry->io.buffer = entry->buffer;
+  entry->io.done = buffer_cache_io_done;
+  entry->io.aux = entry;
+  block_submit (fs_device, &entry->io);
+}
+
+/**
+ * Claims the entry for SECTOR for writing back, if it is still
+ * cached and became dirty at or before timer tick CUTOFF: marks it
+ * busy and clean, and returns it. Otherwise returns NULL. Any disk
+ * I/O in flight on the entry is waited for first.
+ */
+static struct buffer_cache_entry_t*
+buffer_cache_claim_dirty (block_sector_t sector, int64_t cutoff)
+{
+  struct buffer_cache_shard_t *shard = shard_of (sector);
+  struct buffer_cache_entry_t *entry;
+
+  lock_acquire (&shard->lock);
+  while ((entry = buffer_cache_lookup (shard, sector)) != NULL
+         && entry->busy)
+    condvar_wait (&entry->io_done, &shard->lock);
+  if (entry != NULL && entry->dirty && entry->dirty_since <= cutoff) {
+    // cleared now, so that a pinned writer that modifies the sector
+    // while it is being written marks it dirty again on unpin
+    entry->busy = true;
     entry->dirty = false;
   }
+  else
+    entry = NULL;
+  lock_release (&shard->lock);
+  return entry;
+}
+
+/**
+ * Writes back every entry that became dirty at or before timer
+ * tick CUTOFF. The writes are all queued before waiting for any of
+ * them, so that the disk can serve them in sector order and merge
+ * neighbouring ones.
+ *
+ * If WAIT_BUSY, also waits for the writes that others, such as
+ * flushd or an eviction, have already started, so that everything
+ * dirty before the call is on disk when it returns.
+ */
+static void
+buffer_cache_write_back (int64_t cutoff, bool wait_busy)
+{
+  block_sector_t sectors[BUFFER_CACHE_SIZE];
+  struct semaphore done;
+  size_t cnt = 0, submitted = 0;
+  size_t i;
+
+  // collect candidates without locking; they are checked again
+  // under their shard's lock below. a claimed entry is clean but
+  // busy while its write is in flight, and claiming it again waits
+  // for that write, so to catch those every entry is a candidate
+  for (i = 0; i < BUFFER_CACHE_SIZE; ++ i)
+  {
+    struct buffer_cache_entry_t *entry = &cache[i];
+    if (entry->occupied
+        && (wait_busy || (entry->dirty && entry->dirty_since <= cutoff)))
+      sectors[cnt++] = entry->disk_sector;
+  }
+
+  semaphore_init (&done, 0);
+  for (i = 0; i < cnt; ++ i)
+  {
+    struct buffer_cache_entry_t *entry
+      = buffer_cache_claim_dirty (sectors[i], cutoff);
+    if (entry != NULL) {
+      buffer_cache_submit (entry, true, &done);
+      submitted ++;
+    }
+  }
+  while (submitted -- > 0)
+    semaphore_down (&done);
+}
+
+void
+buffer_cache_sync (void)
+{
+  free_map_flush ();
+  buffer_cache_write_back (timer_ticks (), true);
 }
 
 void
 buffer_cache_close (void)
 {
   // flush buffer cache entries
-  lock_acquire (&buffer_cache_lock);
+  buffer_cache_sync ();
+}
 
-  size_t i;
-  for (i = 0; i < BUFFER_CACHE_SIZE; ++ i)
-  {
-    if (cache[i].occupied == false) continue;
-    buffer_cache_flush( &(cache[i]) );
+/**
+ * The write-behind thread: periodically writes back entries that
+ * have stayed dirty for a while, so that evictions mostly find
+ * clean victims and less is lost in a crash.
+ */
+static void
+buffer_cache_flushd (void *aux UNUSED)
+{
+  while (true) {
+    timer_sleep (FLUSH_INTERVAL);
+    // the free map defers its writes to us, so push them into the
+    // cache first to have them age along with everything else
+    free_map_flush ();
+    buffer_cache_write_back (timer_ticks () - FLUSH_AGE, false);
   }
+}
 
-  lock_release (&buffer_cache_lock);
+/**
+ * Returns true, and forgets it, if SECTOR is among the sectors last
+ * evicted from `a1in'. Must be called with queue_lock held.
+ */
+static bool
+buffer_cache_a1out_take (block_sector_t sector)
+{
+  size_t i;
+  for (i = 0; i < A1OUT_SIZE; ++ i)
+    if (a1out[i] == sector) {
+      a1out[i] = A1OUT_EMPTY;
+      return true;
+    }
+  return false;
 }
 
+/**
+ * Checks whether ENTRY, on one of the replacement queues, could be
+ * evicted right now, with its shard's lock held and stored into
+ * *SHARDP if so. Must be called with queue_lock held.
+ */
+static bool
+buffer_cache_evictable (struct buffer_cache_entry_t *entry,
+                        struct buffer_cache_shard_t **shardp)
+{
+  // unoccupied entries on the queues are being filled in by their
+  // owners. an occupied entry's sector only changes once it is
+  // evicted, which needs queue_lock, so its shard is stable here
+  if (!entry->occupied)
+    return false;
+  *shardp = shard_of (entry->disk_sector);
+  lock_acquire (&(*shardp)->lock);
+  if (entry->occupied && !entry->busy && entry->pin_cnt == 0)
+    return true;
+  lock_release (&(*shardp)->lock);
+  return false;
+}
 
 /**
- * Lookup the cache entry, and returns the pointer of buffer_cache_entry_t,
- * or NULL in case of cache miss. (simply traverse the cache entries)
+ * Picks the oldest evictable entry of `a1in', moving any metadata
+ * met on the way over to `am', and returns it with its shard's lock
+ * held, or NULL. Must be called with queue_lock held.
  */
 static struct buffer_cache_entry_t*
-buffer_cache_lookup (block_sector_t sector)
+buffer_cache_pick_a1in (struct buffer_cache_shard_t **shardp)
 {
-  size_t i;
-  for (i = 0; i < BUFFER_CACHE_SIZE; ++ i)
-  {
-    if (cache[i].occupied == false) continue;
-    if (cache[i].disk_sector == sector) {
-      // cache hit.
-      return &(cache[i]);
+  struct list_elem *e = list_begin (&a1in);
+
+  while (e != list_end (&a1in)) {
+    struct buffer_cache_entry_t *entry
+      = list_entry (e, struct buffer_cache_entry_t, queue_elem);
+    e = list_next (e);
+
+    if (!buffer_cache_evictable (entry, shardp))
+      continue;
+    if (entry->cls == CACHE_DATA)
+      return entry;
+
+    // turned out to be metadata after all
+    list_remove (&entry->queue_elem);
+    list_push_back (&am, &entry->queue_elem);
+    a1in_cnt --;
+    am_cnt ++;
+    entry->hot = true;
+    entry->chances = 1;
+    lock_release (&(*shardp)->lock);
+  }
+  return NULL;
+}
+
+/**
+ * Runs the clock over `am', and returns the entry it stops at with
+ * its shard's lock held, or NULL if nothing on `am' can be evicted.
+ * Each pass of the hand clears an entry's reference bit, or uses up
+ * one of its chances; metadata gets a chance whenever it is found
+ * referenced. Must be called with queue_lock held.
+ */
+static struct buffer_cache_entry_t*
+buffer_cache_pick_am (struct buffer_cache_shard_t **shardp)
+{
+  // an entry survives at most two passes, and is evicted on the
+  // third, so this many steps are enough to come round to a victim
+  size_t steps = 3 * am_cnt;
+  struct list_elem *e = list_begin (&am);
+
+  for (; steps > 0; -- steps) {
+    if (e == list_end (&am))
+      e = list_begin (&am);
+    if (e == list_end (&am))
+      break;
+
+    struct buffer_cache_entry_t *entry
+      = list_entry (e, struct buffer_cache_entry_t, queue_elem);
+    e = list_next (e);
+
+    if (!buffer_cache_evictable (entry, shardp))
+      continue;
+    if (entry->access) {
+      entry->access = false;
+      entry->chances = entry->cls == CACHE_DATA ? 0 : 1;
     }
+    else if (entry->chances > 0)
+      entry->chances --;
+    else
+      return entry;
+
+    // give a second chance: move behind the hand
+    list_remove (&entry->queue_elem);
+    list_push_back (&am, &entry->queue_elem);
+    lock_release (&(*shardp)->lock);
   }
-  return NULL; // cache miss
+  return NULL;
 }
 
 /**
- * Obtain a free cache entry slot.
- * If there is an unoccupied slot already, return it.
- * Otherwise, some entry should be evicted by the clock algorithm.
+ * Obtain a free cache entry slot for SECTOR, which holds CLS, not
+ * in any index and marked busy so that nobody else takes it.
+ * If there is an unused slot already, return it.
+ * Otherwise, some entry should be evicted by the 2Q algorithm,
+ * writing it back first if it is dirty.
  */
 static struct buffer_cache_entry_t*
-buffer_cache_evict (void)
+buffer_cache_evict (block_sector_t sector, enum buffer_cache_class cls)
 {
-  ASSERT (lock_held_by_current_thread(&buffer_cache_lock));
+  struct buffer_cache_entry_t *slot = NULL;
+  struct buffer_cache_shard_t *shard;
+
+  lock_acquire (&queue_lock);
+  while (slot == NULL) {
+    if (!list_empty (&free_slots)) {
+      slot = list_entry (list_pop_front (&free_slots),
+                         struct buffer_cache_entry_t, queue_elem);
+      slot->busy = true;
+      break;
+    }
 
-  // clock algorithm
-  static size_t clock = 0;
-  while (true) {
-    if (cache[clock].occupied == false) {
-      // found an empty slot -- use it
-      return &(cache[clock]);
+    // take from `a1in' while it is over its share, or `am' is empty
+    if (a1in_cnt > A1IN_MAX || am_cnt == 0) {
+      slot = buffer_cache_pick_a1in (&shard);
+      if (slot == NULL)
+        slot = buffer_cache_pick_am (&shard);
+    }
+    else {
+      slot = buffer_cache_pick_am (&shard);
+      if (slot == NULL)
+        slot = buffer_cache_pick_a1in (&shard);
     }
 
-    if (cache[clock].access) {
-      // give a second chance
-      cache[clock].access = false;
+    if (slot == NULL) {
+      // every entry is busy or pinned: let their owners make progress
+      lock_release (&queue_lock);
+      thread_yield ();
+      lock_acquire (&queue_lock);
+      continue;
     }
-    else break;
 
-    clock ++;
-    clock %= BUFFER_CACHE_SIZE;
+    slot->busy = true;
+    lock_release (&shard->lock);
+    list_remove (&slot->queue_elem);
+    if (slot->hot)
+      am_cnt --;
+    else {
+      a1in_cnt --;
+      a1out[a1out_next] = slot->disk_sector;
+      a1out_next = (a1out_next + 1) % A1OUT_SIZE;
+    }
+    evict_cnt[slot->cls] ++;
   }
 
-  // evict cache[clock]
-  struct buffer_cache_entry_t *slot = &cache[clock];
-  if (slot->dirty) {
-    // write back into disk
-    buffer_cache_flush (slot);
+  // queue the slot up for SECTOR already; while it is busy, nobody
+  // picks it anyway
+  slot->hot = cls != CACHE_DATA || buffer_cache_a1out_take (sector);
+  slot->chances = cls != CACHE_DATA ? 1 : 0;
+  if (slot->hot) {
+    list_push_back (&am, &slot->queue_elem);
+    am_cnt ++;
   }
+  else {
+    list_push_back (&a1in, &slot->queue_elem);
+    a1in_cnt ++;
+  }
+  lock_release (&queue_lock);
+
+  if (slot->occupied == false)
+    return slot;
 
+  // evict the slot: write back into disk, then drop it from its
+  // shard, waking up whoever waited for it so they look again
+  if (slot->dirty)
+    block_write (fs_device, slot->disk_sector, slot->buffer);
+
+  shard = shard_of (slot->disk_sector);
+  lock_acquire (&shard->lock);
+  hash_delete (&shard->index, &slot->elem);
   slot->occupied = false;
+  slot->dirty = false;
+  condvar_broadcast (&slot->io_done, &shard->lock);
+  lock_release (&shard->lock);
   return slot;
 }
 
+/**
+ * Gives back SLOT, obtained from buffer_cache_evict() but not used.
+ */
+static void
+buffer_cache_unclaim (struct buffer_cache_entry_t *slot)
+{
+  lock_acquire (&queue_lock);
+  ASSERT (slot->busy && !slot->occupied);
+  list_remove (&slot->queue_elem);
+  if (slot->hot)
+    am_cnt --;
+  else
+    a1in_cnt --;
+  list_push_front (&free_slots, &slot->queue_elem);
+  slot->busy = false;
+  lock_release (&queue_lock);
+}
 
-void
-buffer_cache_read (block_sector_t sector, void *target)
+/**
+ * Puts SLOT, obtained from buffer_cache_evict(), into SHARD's index
+ * to hold SECTOR, which holds CLS. The slot stays busy until its
+ * data has been filled in. Must be called with the shard's lock
+ * held.
+ */
+static void
+buffer_cache_install (struct buffer_cache_shard_t *shard,
+                      struct buffer_cache_entry_t *slot,
+                      block_sector_t sector, enum buffer_cache_class cls)
 {
-  lock_acquire (&buffer_cache_lock);
+  ASSERT (lock_held_by_current_thread (&shard->lock));
+  ASSERT (slot->busy && !slot->occupied);
+
+  slot->occupied = true;
+  slot->disk_sector = sector;
+  slot->cls = cls;
+  slot->dirty = false;
+  slot->access = false;
+  shard->miss_cnt[cls] ++;
+  hash_insert (&shard->index, &slot->elem);
+}
 
-  struct buffer_cache_entry_t *slot = buffer_cache_lookup (sector);
-  if (slot == NULL) {
-    // cache miss: need eviction.
-    slot = buffer_cache_evict ();
-    ASSERT (slot != NULL && slot->occupied == false);
+/**
+ * Returns the cache entry for SECTOR, which holds CLS, with its
+ * shard's lock held (stored into *SHARDP), and not busy.
+ * On a cache miss, an entry is evicted to hold SECTOR, which is
+ * read from disk, unless FILL is false because the caller is
+ * about to overwrite the whole sector.
+ */
+static struct buffer_cache_entry_t*
+buffer_cache_get (block_sector_t sector, bool fill,
+                  enum buffer_cache_class cls,
+                  struct buffer_cache_shard_t **shardp)
+{
+  struct buffer_cache_shard_t *shard = shard_of (sector);
+  struct buffer_cache_entry_t *slot;
+
+  *shardp = shard;
+  lock_acquire (&shard->lock);
+  while (true) {
+    slot = buffer_cache_lookup (shard, sector);
+    if (slot != NULL) {
+      if (!slot->busy) {
+        // cache hit.
+        slot->access = true;
+        slot->cls = cls;
+        shard->hit_cnt[cls] ++;
+        return slot;
+      }
+      // being read or written back: wait, then look again, since
+      // it may have been evicted in the meantime
+      condvar_wait (&slot->io_done, &shard->lock);
+      continue;
+    }
+
+    // cache miss: need eviction, without holding the shard lock.
+    lock_release (&shard->lock);
+    slot = buffer_cache_evict (sector, cls);
+    ASSERT (slot != NULL && slot->occupied == false && slot->busy);
+    lock_acquire (&shard->lock);
+
+    if (buffer_cache_lookup (shard, sector) != NULL) {
+      // someone else cached SECTOR while we were evicting
+      lock_release (&shard->lock);
+      buffer_cache_unclaim (slot);
+      lock_acquire (&shard->lock);
+      continue;
+    }
+    break;
+  }
 
-    // fill in the cache entry.
-    slot->occupied = true;
-    slot->disk_sector = sector;
-    slot->dirty = false;
+  buffer_cache_install (shard, slot, sector, cls);
+  if (fill) {
+    lock_release (&shard->lock);
     block_read (fs_device, sector, slot->buffer);
+    lock_acquire (&shard->lock);
   }
+  buffer_cache_unbusy (shard, slot);
+  return slot;
+}
+
+void
+buffer_cache_read (block_sector_t sector, void *target,
+                   enum buffer_cache_class cls)
+{
+  struct buffer_cache_shard_t *shard;
+  struct buffer_cache_entry_t *slot
+    = buffer_cache_get (sector, true, cls, &shard);
 
   // copy the buffer data into memory.
-  slot->access = true;
   memcpy (target, slot->buffer, BLOCK_SECTOR_SIZE);
 
-  lock_release (&buffer_cache_lock);
+  lock_release (&shard->lock);
 }
 
 void
-buffer_cache_write (block_sector_t sector, const void *source)
+buffer_cache_write (block_sector_t sector, const void *source,
+                    enum buffer_cache_class cls)
 {
-  lock_acquire (&buffer_cache_lock);
+  struct buffer_cache_shard_t *shard;
+  struct buffer_cache_entry_t *slot
+    = buffer_cache_get (sector, false, cls, &shard);
 
-  struct buffer_cache_entry_t *slot = buffer_cache_lookup (sector);
-  if (slot == NULL) {
-    // cache miss: need eviction.
-    slot = buffer_cache_evict ();
-    ASSERT (slot != NULL && slot->occupied == false);
+  // copy the data form memory into the buffer cache.
+  buffer_cache_mark_dirty (slot);
+  memcpy (slot->buffer, source, BLOCK_SECTOR_SIZE);
 
-    // fill in the cache entry.
-    slot->occupied = true;
-    slot->disk_sector = sector;
-    slot->dirty = false;
-    block_read (fs_device, sector, slot->buffer);
+  lock_release (&shard->lock);
+}
+
+void *
+buffer_cache_pin (block_sector_t sector, bool fill,
+                  enum buffer_cache_class cls)
+{
+  struct buffer_cache_shard_t *shard;
+  struct buffer_cache_entry_t *slot
+    = buffer_cache_get (sector, fill, cls, &shard);
+
+  slot->pin_cnt ++;
+  lock_release (&shard->lock);
+  return slot->buffer;
+}
+
+void
+buffer_cache_unpin (void *data, bool dirty)
+{
+  size_t i = ((uint8_t *) data - cache_data[0]) / BLOCK_SECTOR_SIZE;
+  ASSERT (i < BUFFER_CACHE_SIZE && cache_data[i] == data);
+
+  struct buffer_cache_entry_t *slot = &cache[i];
+  struct buffer_cache_shard_t *shard = shard_of (slot->disk_sector);
+
+  lock_acquire (&shard->lock);
+  ASSERT (slot->occupied && slot->pin_cnt > 0);
+  slot->pin_cnt --;
+  if (dirty)
+    buffer_cache_mark_dirty (slot);
+  lock_release (&shard->lock);
+}
+
+void
+buffer_cache_prefetch (block_sector_t sector)
+{
+  lock_acquire (&prefetch_lock);
+  if (prefetch_cnt < PREFETCH_QUEUE_SIZE) {
+    prefetch_queue[(prefetch_head + prefetch_cnt) % PREFETCH_QUEUE_SIZE] = sector;
+    prefetch_cnt ++;
+    condvar_signal (&prefetch_ready, &prefetch_lock);
   }
+  lock_release (&prefetch_lock);
+}
 
-  // copy the data form memory into the buffer cache.
-  slot->access = true;
-  slot->dirty = true;
-  memcpy (slot->buffer, source, BLOCK_SECTOR_SIZE);
+/**
+ * The prefetch thread: starts reading the sectors queued by
+ * buffer_cache_prefetch() into the cache. It does not wait for the
+ * reads, so that several can be pending at the disk at once, to be
+ * sorted and merged there.
+ */
+static void
+buffer_cache_prefetchd (void *aux UNUSED)
+{
+  while (true) {
+    lock_acquire (&prefetch_lock);
+    while (prefetch_cnt == 0)
+      condvar_wait (&prefetch_ready, &prefetch_lock);
+    block_sector_t sector = prefetch_queue[prefetch_head];
+    prefetch_head = (prefetch_head + 1) % PREFETCH_QUEUE_SIZE;
+    prefetch_cnt --;
+    lock_release (&prefetch_lock);
+
+    // a sector that is already cached is left alone, so that
+    // read-ahead does not count as a reference to it
+    struct buffer_cache_shard_t *shard = shard_of (sector);
+    lock_acquire (&shard->lock);
+    bool cached = buffer_cache_lookup (shard, sector) != NULL;
+    lock_release (&shard->lock);
+    if (cached)
+      continue;
+
+    semaphore_down (&prefetch_slots);
+    struct buffer_cache_entry_t *slot = buffer_cache_evict (sector, CACHE_DATA);
+    lock_acquire (&shard->lock);
+    if (buffer_cache_lookup (shard, sector) != NULL) {
+      // someone else cached SECTOR while we were evicting
+      lock_release (&shard->lock);
+      buffer_cache_unclaim (slot);
+      semaphore_up (&prefetch_slots);
+      continue;
+    }
+    buffer_cache_install (shard, slot, sector, CACHE_DATA);
+    lock_release (&shard->lock);
+    buffer_cache_submit (slot, false, &prefetch_slots);
+  }
+}
 
-  lock_release (&buffer_cache_lock);
+void
+buffer_cache_print_stats (void)
+{
+  int c;
+
+  for (c = 0; c < CACHE_CLASS_CNT; ++ c) {
+    unsigned long long hits = 0, misses = 0;
+    size_t i;
+
+    // a racy read is good enough for statistics
+    for (i = 0; i < BUFFER_CACHE_SHARDS; ++ i) {
+      hits += shards[i].hit_cnt[c];
+      misses += shards[i].miss_cnt[c];
+    }
+    printf ("Cache (%s): %llu hits, %llu misses, %llu evictions\n",
+            class_names[c], hits, misses, evict_cnt[c]);
+  }
+}
+
+static unsigned
+buffer_cache_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct buffer_cache_entry_t *entry
+    = hash_entry (e, struct buffer_cache_entry_t, elem);
+  return hash_int (entry->disk_sector);
+}
+
+static bool
+buffer_cache_less (const struct hash_elem *a, const struct hash_elem *b,
+                   void *aux UNUSED)
+{
+  return hash_entry (a, struct buffer_cache_entry_t, elem)->disk_sector
+       < hash_entry (b, struct buffer_cache_entry_t, elem)->disk_sector;
 }
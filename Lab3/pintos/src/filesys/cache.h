@@ -1,23 +1,75 @@
 #ifndef FILESYS_CACHE_H
 #define FILESYS_CACHE_H
 
+#include <stdbool.h>
 #include "devices/block.h"
 
 /* Buffer Caches. */
 
+/**
+ * What a cached sector holds, as passed to buffer_cache_read(),
+ * buffer_cache_write() and buffer_cache_pin(). Everything but file
+ * data is metadata, which the cache keeps in preference to file data.
+ */
+enum buffer_cache_class
+  {
+    CACHE_DATA,         /* Regular file data. */
+    CACHE_DIR,          /* Directory data. */
+    CACHE_INDIRECT,     /* Indirect blocks. */
+    CACHE_INODE,        /* On-disk inodes. */
+    CACHE_CLASS_CNT
+  };
+
 void buffer_cache_init (void);
 void buffer_cache_close (void);
 
+/**
+ * Prints hit, miss and eviction counts for each sector class.
+ */
+void buffer_cache_print_stats (void);
+
+/**
+ * Writes every dirty cache entry back to disk.
+ */
+void buffer_cache_sync (void);
+
 /**
  * Read SECTOR_SIZE bytes of data starting from the disk sector
  * specified by 'sector', into `target` (user memory address).
  */
-void buffer_cache_read (block_sector_t sector, void *target);
+void buffer_cache_read (block_sector_t sector, void *target,
+                        enum buffer_cache_class cls);
 
 /**
  * Writes SECTOR_SIZE bytes of data into the disk sector
  * specified by 'sector', from `source` (user memory address).
  */
-void buffer_cache_write (block_sector_t sector, const void *source);
+void buffer_cache_write (block_sector_t sector, const void *source,
+                         enum buffer_cache_class cls);
+
+/**
+ * Returns a pointer to the cached BLOCK_SECTOR_SIZE bytes of disk
+ * sector 'sector', which stays in the cache until the pointer is
+ * given back to buffer_cache_unpin(). The bytes may be read and
+ * modified in place, without copying; callers sharing a sector
+ * must serialize their accesses to it themselves.
+ *
+ * If `fill` is false the sector is not read from disk on a cache
+ * miss, and the caller must overwrite all of it.
+ */
+void *buffer_cache_pin (block_sector_t sector, bool fill,
+                        enum buffer_cache_class cls);
+
+/**
+ * Releases `data`, obtained from buffer_cache_pin(). If `dirty`,
+ * the sector was modified and must eventually be written back.
+ */
+void buffer_cache_unpin (void *data, bool dirty);
+
+/**
+ * Asks for disk sector 'sector' to be read into the cache in the
+ * background, if it is not there already. Never blocks on I/O.
+ */
+void buffer_cache_prefetch (block_sector_t sector);
 
 #endif
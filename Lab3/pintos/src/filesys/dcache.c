@@ -0,0 +1,146 @@
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <string.h>
+#include "filesys/dcache.h"
+#include "filesys/directory.h"
+#include "threads/lock.h"
+
+#define DCACHE_SIZE 256
+
+/* A cached (directory, name) to inode mapping. */
+struct dcache_entry
+  {
+    struct hash_elem elem;      /* Element in `dcache_index'. */
+    struct list_elem lru_elem;  /* Element in `dcache_lru'. */
+    block_sector_t parent;      /* Directory inode, or DCACHE_NEGATIVE
+                                   if the entry is unused. */
+    char name[NAME_MAX + 1];
+    block_sector_t sector;      /* Inode named, or DCACHE_NEGATIVE. */
+  };
+
+static struct dcache_entry dcache[DCACHE_SIZE];
+
+/* Entries in use, by (parent, name). */
+static struct hash dcache_index;
+
+/* Every entry, least recently used first; unused ones come first
+   of all. */
+static struct list dcache_lru;
+
+/* Protects all of the above. */
+static struct lock dcache_lock;
+
+static unsigned
+dcache_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct dcache_entry *entry = hash_entry (e, struct dcache_entry, elem);
+  return hash_string (entry->name) ^ hash_int (entry->parent);
+}
+
+static bool
+dcache_less (const struct hash_elem *a_, const struct hash_elem *b_,
+             void *aux UNUSED)
+{
+  const struct dcache_entry *a = hash_entry (a_, struct dcache_entry, elem);
+  const struct dcache_entry *b = hash_entry (b_, struct dcache_entry, elem);
+
+  if (a->parent != b->parent)
+    return a->parent < b->parent;
+  return strcmp (a->name, b->name) < 0;
+}
+
+void
+dcache_init (void)
+{
+  size_t i;
+
+  hash_init (&dcache_index, dcache_hash, dcache_less, NULL);
+  list_init (&dcache_lru);
+  for (i = 0; i < DCACHE_SIZE; ++ i) {
+    dcache[i].parent = DCACHE_NEGATIVE;
+    list_push_back (&dcache_lru, &dcache[i].lru_elem);
+  }
+  lock_init_adaptive (&dcache_lock, "dcache");
+}
+
+/**
+ * Returns the entry for `name` in `parent`, or NULL.
+ * Must be called with dcache_lock held.
+ */
+static struct dcache_entry *
+dcache_find (block_sector_t parent, const char *name)
+{
+  struct dcache_entry key;
+  struct hash_elem *e;
+
+  ASSERT (lock_held_by_current_thread (&dcache_lock));
+
+  if (strlen (name) > NAME_MAX)
+    return NULL;
+  key.parent = parent;
+  strlcpy (key.name, name, sizeof key.name);
+  e = hash_find (&dcache_index, &key.elem);
+  return e != NULL ? hash_entry (e, struct dcache_entry, elem) : NULL;
+}
+
+bool
+dcache_lookup (block_sector_t parent, const char *name,
+               block_sector_t *sectorp)
+{
+  struct dcache_entry *entry;
+
+  lock_acquire (&dcache_lock);
+  entry = dcache_find (parent, name);
+  if (entry != NULL) {
+    *sectorp = entry->sector;
+    // move to the most recently used end
+    list_remove (&entry->lru_elem);
+    list_push_back (&dcache_lru, &entry->lru_elem);
+  }
+  lock_release (&dcache_lock);
+  return entry != NULL;
+}
+
+void
+dcache_insert (block_sector_t parent, const char *name,
+               block_sector_t sector)
+{
+  struct dcache_entry *entry;
+
+  if (strlen (name) > NAME_MAX)
+    return;
+
+  lock_acquire (&dcache_lock);
+  entry = dcache_find (parent, name);
+  if (entry == NULL) {
+    // recycle the least recently used entry
+    entry = list_entry (list_front (&dcache_lru), struct dcache_entry, lru_elem);
+    if (entry->parent != DCACHE_NEGATIVE)
+      hash_delete (&dcache_index, &entry->elem);
+    entry->parent = parent;
+    strlcpy (entry->name, name, sizeof entry->name);
+    hash_insert (&dcache_index, &entry->elem);
+  }
+  entry->sector = sector;
+  list_remove (&entry->lru_elem);
+  list_push_back (&dcache_lru, &entry->lru_elem);
+  lock_release (&dcache_lock);
+}
+
+void
+dcache_invalidate (block_sector_t parent, const char *name)
+{
+  struct dcache_entry *entry;
+
+  lock_acquire (&dcache_lock);
+  entry = dcache_find (parent, name);
+  if (entry != NULL) {
+    hash_delete (&dcache_index, &entry->elem);
+    entry->parent = DCACHE_NEGATIVE;
+    // make it the first to be recycled
+    list_remove (&entry->lru_elem);
+    list_push_front (&dcache_lru, &entry->lru_elem);
+  }
+  lock_release (&dcache_lock);
+}
@@ -0,0 +1,38 @@
+#ifndef FILESYS_DCACHE_H
+#define FILESYS_DCACHE_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+/* Directory entry cache: remembers what looking up a name in a
+   directory found, including that nothing was found. */
+
+/* Cached result of a lookup that found nothing. */
+#define DCACHE_NEGATIVE ((block_sector_t) -1)
+
+void dcache_init (void);
+
+/**
+ * Looks up `name` in the directory whose inode is in sector
+ * `parent`. Returns false on a cache miss. Otherwise stores the
+ * sector of the entry's inode, or DCACHE_NEGATIVE if there is no
+ * such entry, into `*sectorp`, and returns true.
+ */
+bool dcache_lookup (block_sector_t parent, const char *name,
+                    block_sector_t *sectorp);
+
+/**
+ * Records that `name` in directory `parent` refers to the inode in
+ * `sector`, or to nothing if `sector` is DCACHE_NEGATIVE.
+ */
+void dcache_insert (block_sector_t parent, const char *name,
+                    block_sector_t sector);
+
+/**
+ * Forgets `name` in directory `parent`, whose entry is about to
+ * change. Must be called with the directory locked for writing,
+ * so that no lookup puts the old result back.
+ */
+void dcache_invalidate (block_sector_t parent, const char *name);
+
+#endif
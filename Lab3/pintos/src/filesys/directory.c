@@ -1,11 +1,16 @@
 #include "threads/thread.h"
 #include "filesys/directory.h"
 #include <stdio.h>
+#include <stdint.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
+#include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "threads/rwlock.h"
 
 /* A directory. */
 struct dir
@@ -22,6 +27,46 @@ struct dir_entry
     bool in_use;                        /* In use or free? */
   };
 
+/* The first entry-sized record of every directory is a header
+   instead of an entry.
+
+   Entries always live in the array that follows it.  Small
+   directories are searched by reading that array from the start.
+   Once a directory grows past DIR_INDEX_THRESHOLD entries it also
+   gets an index: a separate inode holding a hash table, with
+   linear probing, whose slots hold the numbers of the entries
+   keyed by a hash of their names.  Free entries of an indexed
+   directory are chained through their `inode_sector' members, so
+   that adding an entry does not have to look for one either. */
+struct dir_header
+  {
+    block_sector_t parent;              /* Sector of parent directory. */
+    uint32_t magic;                     /* DIR_INDEX_MAGIC if indexed. */
+    block_sector_t index_sector;        /* Inode of the index. */
+    uint32_t slot_cnt;                  /* Index slots, a power of 2. */
+    uint32_t free_head;                 /* First free entry, or 0. */
+  };
+
+/* Start of an index inode, followed by `slot_cnt' uint32_t slots. */
+struct dir_index_header
+  {
+    uint32_t entry_cnt;                 /* Entries in use. */
+    uint32_t used_cnt;                  /* Slots not SLOT_EMPTY. */
+  };
+
+#define DIR_INDEX_MAGIC 0x58444e49      /* "INDX" */
+#define DIR_INDEX_THRESHOLD 64          /* Entries before indexing. */
+#define DIR_INDEX_MIN_SLOTS 256
+
+/* Special index slot values.  Other values are entry numbers,
+   which start at 1 since the header takes the place of entry 0. */
+#define SLOT_EMPTY 0                    /* Never used; ends a probe. */
+#define SLOT_DELETED UINT32_MAX         /* Entry was removed. */
+
+static bool dir_index_build (struct dir *, struct dir_header *);
+static void dir_index_drop (struct dir *);
+static void index_free (const struct dir_header *);
+
 
 /*
  * Split path.
@@ -32,7 +77,7 @@ split_path_filename(const char *path,
     char *directory, char *filename)
 {
   int l = strlen(path);
-  char *s = (char*) malloc( sizeof(char) * (l + 1) );
+  char s[l + 1];
   memcpy (s, path, sizeof(char) * (l + 1));
 
   // absolute path handling
@@ -59,7 +104,6 @@ split_path_filename(const char *path,
 
   if(dir) *dir = '\0';
   memcpy (filename, last_token, sizeof(char) * (strlen(last_token) + 1));
-  free (s);
 
 }
 
@@ -70,16 +114,19 @@ bool
 dir_create (block_sector_t sector, size_t entry_cnt)
 {
   bool success = true;
+  ASSERT (sizeof (struct dir_header) == sizeof (struct dir_entry));
   success = inode_create (sector, entry_cnt * sizeof (struct dir_entry), /*is_dir*/ true);
   if(!success) return false;
 
-  // The first (offset 0) dir entry is for parent directory; do self-referencing
+  // The first (offset 0) dir entry is the header, which names the parent
+  // directory; do self-referencing
   // Actual parent directory will be set on execution of dir_add()
   struct dir *dir = dir_open( inode_open(sector) );
   ASSERT (dir != NULL);
-  struct dir_entry e;
-  e.inode_sector = sector;
-  if (inode_write_at(dir->inode, &e, sizeof e, 0) != sizeof e) {
+  struct dir_header h;
+  memset (&h, 0, sizeof h);
+  h.parent = sector;
+  if (inode_write_at(dir->inode, &h, sizeof h, 0) != sizeof h) {
     success = false;
   }
   dir_close (dir);
@@ -194,6 +241,105 @@ dir_get_inode (struct dir *dir)
   return dir->inode;
 }
 
+/* Reads the header of DIR into *H. */
+static bool
+read_header (const struct dir *dir, struct dir_header *h)
+{
+  return inode_read_at (dir->inode, h, sizeof *h, 0) == sizeof *h;
+}
+
+/* Writes *H as the header of DIR. */
+static bool
+write_header (struct dir *dir, const struct dir_header *h)
+{
+  return inode_write_at (dir->inode, h, sizeof *h, 0) == sizeof *h;
+}
+
+/* Returns the byte offset of index slot SLOT. */
+static off_t
+slot_ofs (uint32_t slot)
+{
+  return sizeof (struct dir_index_header) + slot * sizeof (uint32_t);
+}
+
+/* Returns the value of slot SLOT of index INDEX. */
+static uint32_t
+slot_get (struct inode *index, uint32_t slot)
+{
+  uint32_t value = SLOT_EMPTY;
+  inode_read_at (index, &value, sizeof value, slot_ofs (slot));
+  return value;
+}
+
+/* Sets slot SLOT of index INDEX to VALUE. */
+static bool
+slot_set (struct inode *index, uint32_t slot, uint32_t value)
+{
+  return inode_write_at (index, &value, sizeof value, slot_ofs (slot))
+         == sizeof value;
+}
+
+/* Searches index INDEX of DIR, whose header is H, for NAME, like
+   lookup().  On success, also sets *SLOTP to the slot that refers
+   to the entry if SLOTP is non-null. */
+static bool
+index_lookup (const struct dir *dir, const struct dir_header *h,
+              struct inode *index, const char *name,
+              struct dir_entry *ep, off_t *ofsp, uint32_t *slotp)
+{
+  uint32_t mask = h->slot_cnt - 1;
+  uint32_t slot = hash_string (name) & mask;
+  uint32_t probes;
+
+  for (probes = 0; probes < h->slot_cnt; probes++, slot = (slot + 1) & mask)
+    {
+      uint32_t entry = slot_get (index, slot);
+      struct dir_entry e;
+      off_t ofs;
+
+      if (entry == SLOT_EMPTY)
+        break;
+      if (entry == SLOT_DELETED)
+        continue;
+
+      ofs = entry * sizeof e;
+      if (inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e
+          && e.in_use && !strcmp (name, e.name))
+        {
+          if (ep != NULL)
+            *ep = e;
+          if (ofsp != NULL)
+            *ofsp = ofs;
+          if (slotp != NULL)
+            *slotp = slot;
+          return true;
+        }
+    }
+  return false;
+}
+
+/* Makes entry number ENTRY, which must not be in the index yet,
+   reachable through index INDEX of a directory whose header is H.
+   The index must have a slot that is not in use. */
+static bool
+index_insert (const struct dir_header *h, struct inode *index,
+              const char *name, uint32_t entry,
+              struct dir_index_header *ih)
+{
+  uint32_t mask = h->slot_cnt - 1;
+  uint32_t slot = hash_string (name) & mask;
+  uint32_t value;
+
+  while ((value = slot_get (index, slot)) != SLOT_EMPTY
+         && value != SLOT_DELETED)
+    slot = (slot + 1) & mask;
+
+  if (value == SLOT_EMPTY)
+    ih->used_cnt++;
+  ih->entry_cnt++;
+  return slot_set (index, slot, entry);
+}
+
 /* Searches DIR for a file with the given NAME.
    If successful, returns true, sets *EP to the directory entry
    if EP is non-null, and sets *OFSP to the byte offset of the
@@ -203,12 +349,22 @@ static bool
 lookup (const struct dir *dir, const char *name,
         struct dir_entry *ep, off_t *ofsp)
 {
+  struct dir_header h;
   struct dir_entry e;
   size_t ofs;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  if (read_header (dir, &h) && h.magic == DIR_INDEX_MAGIC)
+    {
+      struct inode *index = inode_open (h.index_sector);
+      bool found = index != NULL
+                   && index_lookup (dir, &h, index, name, ep, ofsp, NULL);
+      inode_close (index);
+      return found;
+    }
+
   for (ofs = sizeof e; /* 0-pos is for parent directory */
        inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
        ofs += sizeof e)
@@ -229,15 +385,34 @@ dir_is_empty (const struct dir *dir)
 {
   struct dir_entry e;
   off_t ofs;
+  bool is_empty = true;
+  struct dir_header h;
+
+  rwlock_acquire_read (inode_dir_lock (dir->inode));
+  if (read_header (dir, &h) && h.magic == DIR_INDEX_MAGIC) {
+    // indexed directory : the index counts its entries
+    struct inode *index = inode_open (h.index_sector);
+    struct dir_index_header ih;
+    if (index != NULL
+        && inode_read_at (index, &ih, sizeof ih, 0) == sizeof ih)
+      is_empty = ih.entry_cnt == 0;
+    inode_close (index);
+    goto done;
+  }
 
   for (ofs = sizeof e; /* 0-pos is for parent directory */
        inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
        ofs += sizeof e)
   {
-    if (e.in_use)
-      return false;
+    if (e.in_use) {
+      is_empty = false;
+      break;
+    }
   }
-  return true;
+
+ done:
+  rwlock_release_read (inode_dir_lock (dir->inode));
+  return is_empty;
 }
 
 /* Searches DIR for a file with the given NAME
@@ -253,6 +428,9 @@ dir_lookup (const struct dir *dir, const char *name,
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  // lookups in the same directory may run in parallel; the entry
+  // found stays valid until its inode is opened
+  rwlock_acquire_read (inode_dir_lock (dir->inode));
   if (strcmp (name, ".") == 0) {
     // current directory
     *inode = inode_reopen (dir->inode);
@@ -262,12 +440,19 @@ dir_lookup (const struct dir *dir, const char *name,
     inode_read_at (dir->inode, &e, sizeof e, 0);
     *inode = inode_open (e.inode_sector);
   }
-  else if (lookup (dir, name, &e, NULL)) {
-    // normal lookup. lookuped entry is stored into e
-    *inode = inode_open (e.inode_sector);
+  else {
+    // normal lookup, served from the dentry cache when possible.
+    // dir_add() and dir_remove() invalidate it under the write lock,
+    // so a result cached under the read lock is never stale
+    block_sector_t parent = inode_get_inumber (dir->inode);
+    block_sector_t sector;
+    if (!dcache_lookup (parent, name, &sector)) {
+      sector = lookup (dir, name, &e, NULL) ? e.inode_sector : DCACHE_NEGATIVE;
+      dcache_insert (parent, name, sector);
+    }
+    *inode = sector != DCACHE_NEGATIVE ? inode_open (sector) : NULL;
   }
-  else
-    *inode = NULL;
+  rwlock_release_read (inode_dir_lock (dir->inode));
 
   return *inode != NULL;
 }
@@ -282,6 +467,7 @@ dir_lookup (const struct dir *dir, const char *name,
 bool
 dir_add (struct dir *dir, const char *name, block_sector_t inode_sector, bool is_dir)
 {
+  struct dir_header h;
   struct dir_entry e;
   off_t ofs;
   bool success = false;
@@ -293,43 +479,94 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector, bool is
   if (*name == '\0' || strlen (name) > NAME_MAX)
     return false;
 
+  rwlock_acquire_write (inode_dir_lock (dir->inode));
+  dcache_invalidate (inode_get_inumber (dir->inode), name);
+
   /* Check that NAME is not in use. */
   if (lookup (dir, name, NULL, NULL))
     goto done;
 
   // update the child directory [inode_sector] has a parent directory [dir]
+  // : only the parent field of its header changes
   if (is_dir)
   {
-    /* e is a parent-directory-entry here */
     struct dir *child_dir = dir_open( inode_open(inode_sector) );
     if(child_dir == NULL) goto done;
-    e.inode_sector = inode_get_inumber( dir_get_inode(dir) );
-    if (inode_write_at(child_dir->inode, &e, sizeof e, 0) != sizeof e) {
+    block_sector_t parent = inode_get_inumber( dir_get_inode(dir) );
+    if (inode_write_at(child_dir->inode, &parent, sizeof parent, 0) != sizeof parent) {
       dir_close (child_dir);
       goto done;
     }
     dir_close (child_dir);
   }
 
-  /* Set OFS to offset of free slot.
-     If there are no free slots, then it will be set to the
-     current end-of-file.
+  if (!read_header (dir, &h))
+    goto done;
 
-     inode_read_at() will only return a short read at end of file.
-     Otherwise, we'd need to verify that we didn't get a short
-     read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e)
-    if (!e.in_use)
-      break;
+  if (h.magic != DIR_INDEX_MAGIC) {
+    /* Set OFS to offset of free slot.
+       If there are no free slots, then it will be set to the
+       current end-of-file.
+
+       inode_read_at() will only return a short read at end of file.
+       Otherwise, we'd need to verify that we didn't get a short
+       read due to something intermittent such as low memory. */
+    for (ofs = sizeof e; /* 0-pos is for parent directory */
+         inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+         ofs += sizeof e)
+      if (!e.in_use)
+        break;
+
+    /* Write slot, unless the directory has grown big enough to be
+       worth indexing. */
+    if (ofs <= DIR_INDEX_THRESHOLD * (off_t) sizeof e) {
+      e.in_use = true;
+      strlcpy (e.name, name, sizeof e.name);
+      e.inode_sector = inode_sector;
+      success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+      goto done;
+    }
+    if (!dir_index_build (dir, &h))
+      goto done;
+  }
+
+  /* Indexed directory: take the first free entry, or append one. */
+  if (h.free_head != 0) {
+    ofs = h.free_head * sizeof e;
+    if (inode_read_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
+      goto done;
+    h.free_head = e.inode_sector;
+  }
+  else
+    ofs = inode_length (dir->inode);
 
-  /* Write slot. */
   e.in_use = true;
   strlcpy (e.name, name, sizeof e.name);
   e.inode_sector = inode_sector;
-  success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+  if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e
+      || !write_header (dir, &h))
+    goto done;
+
+  /* Then make it reachable through the index, first rebuilding the
+     index with more slots if it would become more than 3/4 full.
+     The rebuild finds the new entry along with the others. */
+  struct inode *index = inode_open (h.index_sector);
+  struct dir_index_header ih;
+  if (index == NULL)
+    goto done;
+  if (inode_read_at (index, &ih, sizeof ih, 0) == sizeof ih) {
+    if ((ih.used_cnt + 1) * 4 > h.slot_cnt * 3) {
+      inode_close (index);
+      success = dir_index_build (dir, &h);
+      goto done;
+    }
+    success = index_insert (&h, index, name, ofs / sizeof e, &ih)
+              && inode_write_at (index, &ih, sizeof ih, 0) == sizeof ih;
+  }
+  inode_close (index);
 
  done:
+  rwlock_release_write (inode_dir_lock (dir->inode));
   return success;
 }
 
@@ -342,13 +579,28 @@ dir_remove (struct dir *dir, const char *name)
   struct dir_entry e;
   struct inode *inode = NULL;
   bool success = false;
+  struct dir_header h;
+  struct inode *index = NULL;
+  uint32_t slot = 0;
   off_t ofs;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  /* Find directory entry. */
-  if (!lookup (dir, name, &e, &ofs))
+  rwlock_acquire_write (inode_dir_lock (dir->inode));
+  dcache_invalidate (inode_get_inumber (dir->inode), name);
+
+  /* Find directory entry, and its index slot if the directory is
+     indexed. */
+  if (!read_header (dir, &h))
+    goto done;
+  if (h.magic == DIR_INDEX_MAGIC) {
+    index = inode_open (h.index_sector);
+    if (index == NULL
+        || !index_lookup (dir, &h, index, name, &e, &ofs, &slot))
+      goto done;
+  }
+  else if (!lookup (dir, name, &e, &ofs))
     goto done;
 
   /* Open inode. */
@@ -359,14 +611,29 @@ dir_remove (struct dir *dir, const char *name)
   /* Prevent removing non-empty directory. */
   if (inode_is_directory (inode)) {
     // target : the directory to be removed. (dir : the base directory)
-    struct dir *target = dir_open (inode);
-    bool is_empty = dir_is_empty (target);
+    struct dir *target = dir_open (inode_reopen (inode));
+    bool is_empty = target != NULL && dir_is_empty (target);
+    if (is_empty)
+      dir_index_drop (target);
     dir_close (target);
     if (! is_empty) goto done; // can't delete
   }
 
-  /* Erase directory entry. */
+  /* Erase directory entry.  An indexed directory also chains it
+     onto its free entries and drops it from the index. */
   e.in_use = false;
+  if (index != NULL) {
+    struct dir_index_header ih;
+    e.inode_sector = h.free_head;
+    h.free_head = ofs / sizeof e;
+    if (inode_read_at (index, &ih, sizeof ih, 0) != sizeof ih
+        || !slot_set (index, slot, SLOT_DELETED))
+      goto done;
+    ih.entry_cnt--;
+    if (inode_write_at (index, &ih, sizeof ih, 0) != sizeof ih
+        || !write_header (dir, &h))
+      goto done;
+  }
   if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
     goto done;
 
@@ -375,10 +642,81 @@ dir_remove (struct dir *dir, const char *name)
   success = true;
 
  done:
+  rwlock_release_write (inode_dir_lock (dir->inode));
+  inode_close (index);
   inode_close (inode);
   return success;
 }
 
+/* Builds a new index for DIR, whose header is *H, from its entry
+   array, with room for twice as many entries as are in use, then
+   frees the old index if there was one.  Free entries are chained
+   up again along the way.  Updates *H and writes it back. */
+static bool
+dir_index_build (struct dir *dir, struct dir_header *h)
+{
+  struct dir_index_header ih = { 0, 0 };
+  struct dir_header new_h = *h;
+  struct inode *index;
+  struct dir_entry e;
+  uint32_t entry_cnt = 0, entry;
+  off_t ofs;
+
+  /* Size the new index. */
+  for (ofs = sizeof e; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+       ofs += sizeof e)
+    if (e.in_use)
+      entry_cnt++;
+  new_h.slot_cnt = DIR_INDEX_MIN_SLOTS;
+  while (new_h.slot_cnt < entry_cnt * 2)
+    new_h.slot_cnt *= 2;
+
+  /* Create it; new inodes read as zeros, that is, all SLOT_EMPTY. */
+  if (!free_map_allocate (1, &new_h.index_sector))
+    return false;
+  if (!inode_create (new_h.index_sector, slot_ofs (new_h.slot_cnt), false)
+      || (index = inode_open (new_h.index_sector)) == NULL)
+    {
+      free_map_release (new_h.index_sector, 1);
+      return false;
+    }
+
+  /* Fill it in, chaining the free entries in ascending order. */
+  new_h.magic = DIR_INDEX_MAGIC;
+  new_h.free_head = 0;
+  for (entry = inode_length (dir->inode) / sizeof e - 1; entry > 0; entry--)
+    {
+      ofs = entry * sizeof e;
+      if (inode_read_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
+        goto fail;
+      if (e.in_use)
+        {
+          if (!index_insert (&new_h, index, e.name, entry, &ih))
+            goto fail;
+        }
+      else
+        {
+          e.inode_sector = new_h.free_head;
+          new_h.free_head = entry;
+          if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
+            goto fail;
+        }
+    }
+  if (inode_write_at (index, &ih, sizeof ih, 0) != sizeof ih
+      || !write_header (dir, &new_h))
+    goto fail;
+  inode_close (index);
+
+  index_free (h);
+  *h = new_h;
+  return true;
+
+ fail:
+  inode_remove (index);
+  inode_close (index);
+  return false;
+}
+
 /* Reads the next directory entry in DIR and stores the name in
    NAME.  Returns true if successful, false if the directory
    contains no more entries. */
@@ -386,15 +724,53 @@ bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
   struct dir_entry e;
+  bool found = false;
 
+  rwlock_acquire_read (inode_dir_lock (dir->inode));
   while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e)
     {
       dir->pos += sizeof e;
       if (e.in_use)
         {
           strlcpy (name, e.name, NAME_MAX + 1);
-          return true;
+          found = true;
+          break;
         }
     }
-  return false;
+  rwlock_release_read (inode_dir_lock (dir->inode));
+  return found;
+}
+
+/* Frees the index of the directory whose header is H, if it has
+   one. */
+static void
+index_free (const struct dir_header *h)
+{
+  if (h->magic == DIR_INDEX_MAGIC)
+    {
+      struct inode *index = inode_open (h->index_sector);
+      if (index != NULL)
+        {
+          inode_remove (index);
+          inode_close (index);
+        }
+    }
+}
+
+/* Frees the index of empty directory DIR, which is about to be
+   removed, turning it back into a plain directory. */
+static void
+dir_index_drop (struct dir *dir)
+{
+  struct dir_header h;
+
+  rwlock_acquire_write (inode_dir_lock (dir->inode));
+  if (read_header (dir, &h) && h.magic == DIR_INDEX_MAGIC)
+    {
+      index_free (&h);
+      h.magic = 0;
+      h.free_head = 0;
+      write_header (dir, &h);
+    }
+  rwlock_release_write (inode_dir_lock (dir->inode));
 }
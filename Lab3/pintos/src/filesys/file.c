@@ -3,14 +3,22 @@
 #include "filesys/inode.h"
 #include "threads/malloc.h"
 
+/* Number of bytes past a sequential read that are prefetched
+   into the buffer cache. */
+#define READ_AHEAD_BYTES (8 * BLOCK_SECTOR_SIZE)
+
 /* An open file. */
 struct file
   {
     struct inode *inode;        /* File's inode. */
     off_t pos;                  /* Current position. */
     bool deny_write;            /* Has file_deny_write() been called? */
+    off_t ra_next;              /* Where a sequential read would start. */
+    off_t ra_limit;             /* End of the bytes already prefetched. */
   };
 
+static void read_ahead (struct file *, off_t ofs, off_t size);
+
 /* Opens a file for the given INODE, of which it takes ownership,
    and returns the new file.  Returns a null pointer if an
    allocation fails or if INODE is null. */
@@ -23,6 +31,7 @@ file_open (struct inode *inode)
       file->inode = inode;
       file->pos = 0;
       file->deny_write = false;
+      file->ra_next = file->ra_limit = 0;
       return file;
     }
   else
@@ -68,8 +77,8 @@ file_get_inode (struct file *file)
 off_t
 file_read (struct file *file, void *buffer, off_t size)
 {
-  
   off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+  read_ahead (file, file->pos, bytes_read);
   file->pos += bytes_read;
   return bytes_read;
 }
@@ -82,7 +91,9 @@ file_read (struct file *file, void *buffer, off_t size)
 off_t
 file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs)
 {
-  return inode_read_at (file->inode, buffer, size, file_ofs);
+  off_t bytes_read = inode_read_at (file->inode, buffer, size, file_ofs);
+  read_ahead (file, file_ofs, bytes_read);
+  return bytes_read;
 }
 
 /* Writes SIZE bytes from BUFFER into FILE,
@@ -167,3 +178,31 @@ file_tell (struct file *file)
   ASSERT (file != NULL);
   return file->pos;
 }
+
+/* Notes that SIZE bytes were just read from FILE at offset OFS.
+   If the read continued where the previous one left off, asks for
+   the next READ_AHEAD_BYTES of the file to be brought into the
+   buffer cache in the background, so that the following reads
+   find them there. */
+static void
+read_ahead (struct file *file, off_t ofs, off_t size)
+{
+  off_t end = ofs + size;
+
+  if (ofs != file->ra_next || size == 0)
+    {
+      /* Random access: start over from here. */
+      file->ra_next = file->ra_limit = end;
+      return;
+    }
+
+  file->ra_next = end;
+  if (file->ra_limit < end)
+    file->ra_limit = end;
+  if (file->ra_limit < end + READ_AHEAD_BYTES)
+    {
+      inode_read_ahead (file->inode, file->ra_limit,
+                        end + READ_AHEAD_BYTES - file->ra_limit);
+      file->ra_limit = end + READ_AHEAD_BYTES;
+    }
+}
@@ -1,6 +1,7 @@
 #include "threads/thread.h"
 #include "filesys/filesys.h"
 #include "filesys/cache.h"
+#include "filesys/dcache.h"
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
@@ -24,6 +25,7 @@ filesys_init (bool format)
     PANIC ("No file system device found, can't initialize file system.");
 
   inode_init ();
+  dcache_init ();
   free_map_init ();
 
   buffer_cache_init ();
@@ -32,6 +34,13 @@ filesys_init (bool format)
     do_format ();
 
   free_map_open ();
+
+  /* New inodes use the format that the file system was made with. */
+  struct inode *root = inode_open (ROOT_DIR_SECTOR);
+  if (root == NULL)
+    PANIC ("can't open root directory");
+  inode_set_format (inode_get_format (root));
+  inode_close (root);
 }
 
 /* Shuts down the file system module, writing any unwritten data
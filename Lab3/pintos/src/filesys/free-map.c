@@ -1,13 +1,40 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "threads/lock.h"
+
+/* Number of free map bits stored in one sector of the free map
+   file. */
+#define BITS_PER_SECTOR (BLOCK_SECTOR_SIZE * 8)
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
 
+/* Sectors of the free map file that differ from the in-memory
+   free map, one bit per sector.  Changes to the free map only mark
+   the sectors they touch here; free_map_flush() writes them back
+   later, so that many allocations share a single write. */
+static struct bitmap *free_map_dirty;
+
+/* Protects free_map, free_map_dirty and free_map_file. */
+static struct lock free_map_lock;
+
+/* Marks the free map file sectors that hold the bits for sectors
+   SECTOR through SECTOR + CNT - 1 as dirty. */
+static void
+mark_dirty (block_sector_t sector, size_t cnt)
+{
+  size_t first = sector / BITS_PER_SECTOR;
+  size_t last = (sector + cnt - 1) / BITS_PER_SECTOR;
+
+  ASSERT (cnt > 0);
+  bitmap_set_multiple (free_map_dirty, first, last - first + 1, true);
+}
+
 /* Initializes the free map. */
 void
 free_map_init (void)
@@ -15,6 +42,11 @@ free_map_init (void)
   free_map = bitmap_create (block_size (fs_device));
   if (free_map == NULL)
     PANIC ("bitmap creation failed--file system device is too large");
+  free_map_dirty = bitmap_create (DIV_ROUND_UP (bitmap_file_size (free_map),
+                                                BLOCK_SECTOR_SIZE));
+  if (free_map_dirty == NULL)
+    PANIC ("bitmap creation failed--file system device is too large");
+  lock_init (&free_map_lock);
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
 }
@@ -22,31 +54,75 @@ free_map_init (void)
 /* Allocates CNT consecutive sectors from the free map and stores
    the first into *SECTORP.
    Returns true if successful, false if not enough consecutive
-   sectors were available or if the free_map file could not be
-   written. */
+   sectors were available. */
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+  block_sector_t sector;
+
+  lock_acquire (&free_map_lock);
+  sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
+  if (sector != BITMAP_ERROR)
     {
-      bitmap_set_multiple (free_map, sector, cnt, false);
-      sector = BITMAP_ERROR;
+      mark_dirty (sector, cnt);
+      *sectorp = sector;
     }
-  if (sector != BITMAP_ERROR)
-    *sectorp = sector;
+  lock_release (&free_map_lock);
   return sector != BITMAP_ERROR;
 }
 
+/* Allocates up to CNT consecutive sectors starting exactly at
+   SECTOR, stopping at the first sector that is in use.  Returns
+   the number of sectors allocated, which may be 0. */
+size_t
+free_map_allocate_at (block_sector_t sector, size_t cnt)
+{
+  size_t n = 0;
+
+  lock_acquire (&free_map_lock);
+  while (n < cnt && sector + n < bitmap_size (free_map)
+         && !bitmap_test (free_map, sector + n))
+    n++;
+  if (n > 0)
+    {
+      bitmap_set_multiple (free_map, sector, n, true);
+      mark_dirty (sector, n);
+    }
+  lock_release (&free_map_lock);
+  return n;
+}
+
 /* Makes CNT sectors starting at SECTOR available for use. */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
+  lock_acquire (&free_map_lock);
   ASSERT (bitmap_all (free_map, sector, cnt));
   bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  mark_dirty (sector, cnt);
+  lock_release (&free_map_lock);
+}
+
+/* Writes the sectors of the free map file that changed since they
+   were last written, in ascending order.  Does nothing before the
+   free map file is open.  The writes go through the buffer cache,
+   so this should be followed by writing the cache back. */
+void
+free_map_flush (void)
+{
+  size_t idx = 0;
+
+  lock_acquire (&free_map_lock);
+  if (free_map_file != NULL)
+    while ((idx = bitmap_scan (free_map_dirty, idx, 1, true)) != BITMAP_ERROR)
+      {
+        if (!bitmap_write_part (free_map, free_map_file,
+                                idx * BLOCK_SECTOR_SIZE, BLOCK_SECTOR_SIZE))
+          PANIC ("can't write free map");
+        bitmap_reset (free_map_dirty, idx);
+        idx++;
+      }
+  lock_release (&free_map_lock);
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -58,13 +134,18 @@ free_map_open (void)
     PANIC ("can't open free map");
   if (!bitmap_read (free_map, free_map_file))
     PANIC ("can't read free map");
+  bitmap_set_all (free_map_dirty, false);
 }
 
 /* Writes the free map to disk and closes the free map file. */
 void
 free_map_close (void)
 {
+  free_map_flush ();
+  lock_acquire (&free_map_lock);
   file_close (free_map_file);
+  free_map_file = NULL;
+  lock_release (&free_map_lock);
 }
 
 /* Creates a new free map file on disk and writes the free map to
@@ -82,4 +163,5 @@ free_map_create (void)
     PANIC ("can't open free map");
   if (!bitmap_write (free_map, free_map_file))
     PANIC ("can't write free map");
+  bitmap_set_all (free_map_dirty, false);
 }
@@ -0,0 +1,230 @@
+#include "filesys/fsbench.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "devices/ide.h"
+#include "devices/timer.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "threads/palloc.h"
+#include "threads/semaphore.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Benchmarks for the block layer and the IDE driver, run as
+   kernel actions.  They print their timings in timer ticks and
+   do not check them: the numbers depend on the simulator and on
+   the machine it runs on. */
+
+/* Most sectors read per pass of fsbench_ide(): 4 MB. */
+#define IDE_SECTORS 8192
+
+/* Sectors per request: 32 kB. */
+#define BUF_PAGES 8
+#define BUF_SECTORS (BUF_PAGES * PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* Pages written to swap, and read from a file, per pass of
+   fsbench_channels(). */
+#define SWAP_PAGES 256
+#define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
+#define CHANNELS_FILE "/channels-bench"
+
+static int64_t ide_pass (struct block *, void *, block_sector_t,
+                         const char *);
+static void swap_pass (void);
+static void file_pass (void);
+static thread_func swap_thread;
+static thread_func spin;
+
+/* Buffers and device used by fsbench_channels(). */
+static void *swap_page, *file_page;
+static struct block *swap_disk;
+
+/* Incremented by the spinning thread while a benchmark runs. */
+static volatile unsigned long long spin_cnt;
+static volatile bool spin_stop;
+
+/* Reads the start of the file system disk sequentially, first
+   by programmed I/O and then by bus-master DMA, and compares the
+   time taken.  Also counts how often a low-priority thread gets
+   to run during each pass, which shows how much of the CPU the
+   transfers leave to other threads: under PIO the CPU copies
+   every byte itself.  Nothing is written. */
+void
+fsbench_ide (char **argv UNUSED)
+{
+  struct block *disk = block_get_role (BLOCK_FILESYS);
+  block_sector_t sector_cnt;
+  int64_t pio, dma;
+  void *buf;
+
+  if (disk == NULL)
+    PANIC ("no file system device");
+  sector_cnt = block_size (disk) < IDE_SECTORS ? block_size (disk)
+                                               : IDE_SECTORS;
+  sector_cnt -= sector_cnt % BUF_SECTORS;
+  if (sector_cnt == 0)
+    PANIC ("%s: too small to benchmark", block_name (disk));
+  buf = palloc_get_multiple (PAL_ASSERT, BUF_PAGES);
+
+  printf ("Reading %"PRDSNu" sectors of %s, %d at a time...\n",
+          sector_cnt, block_name (disk), BUF_SECTORS);
+  spin_stop = false;
+  thread_create ("spin", PRI_MIN, spin, NULL);
+
+  ide_set_dma (false);
+  pio = ide_pass (disk, buf, sector_cnt, "PIO");
+  if (ide_set_dma (true))
+    {
+      dma = ide_pass (disk, buf, sector_cnt, "DMA");
+      if (pio > 0 && dma > 0)
+        printf ("DMA takes %lld%% of the time PIO takes.\n",
+                dma * 100 / pio);
+    }
+  else
+    printf ("No bus-master IDE controller: DMA not timed.\n");
+
+  spin_stop = true;
+  palloc_free_multiple (buf, BUF_PAGES);
+}
+
+/* Reads SECTOR_CNT sectors from the start of DISK into BUF,
+   prints how long that took and how much the spinning thread ran
+   meanwhile, and returns the time taken in ticks. */
+static int64_t
+ide_pass (struct block *disk, void *buf, block_sector_t sector_cnt,
+          const char *name)
+{
+  unsigned long long spin_start = spin_cnt;
+  block_sector_t sector;
+  int64_t start, elapsed;
+
+  start = timer_ticks ();
+  for (sector = 0; sector < sector_cnt; sector += BUF_SECTORS)
+    block_read_multiple (disk, sector, BUF_SECTORS, buf);
+  elapsed = timer_elapsed (start);
+
+  printf ("%s: %lld ticks (%lld kB/s), %llu spins meanwhile.\n",
+          name, elapsed,
+          elapsed > 0 ? (int64_t) sector_cnt / 2 * TIMER_FREQ / elapsed : 0,
+          spin_cnt - spin_start);
+  return elapsed;
+}
+
+/* Writes SWAP_PAGES pages to the swap device, the way swapping
+   out does, and reads a file of the same size through the file
+   system, first one after the other and then at the same time in
+   two threads.  The file system and swap disks are normally on
+   different channels ("pintos" puts them on hd0:0 and hd1:0), so
+   the two should overlap: together they should take about as long
+   as the slower of the two, not as long as both added up.  The
+   "while another channel was busy" counts that ide_print_stats()
+   prints at power off tell how often transfers overlapped.
+
+   The swap device is overwritten, so this must run before
+   anything has been swapped out. */
+void
+fsbench_channels (char **argv UNUSED)
+{
+  struct semaphore swap_done;
+  struct file *file;
+  int64_t start, swap_ticks, file_ticks, both_ticks;
+  int i;
+
+  swap_disk = block_get_role (BLOCK_SWAP);
+  if (swap_disk == NULL)
+    PANIC ("no swap device");
+  if (block_size (swap_disk) < SWAP_PAGES * SECTORS_PER_PAGE)
+    PANIC ("%s: too small to benchmark", block_name (swap_disk));
+  printf ("File system on %s, swap on %s.\n",
+          block_name (block_get_role (BLOCK_FILESYS)),
+          block_name (swap_disk));
+
+  swap_page = palloc_get_page (PAL_ASSERT);
+  file_page = palloc_get_page (PAL_ASSERT);
+  memset (swap_page, 0x5a, PGSIZE);
+
+  /* Make the file.  It is much bigger than the buffer cache, so
+     reading it goes to the disk. */
+  if (!filesys_create (CHANNELS_FILE, 0, false))
+    PANIC ("%s: create failed", CHANNELS_FILE);
+  file = filesys_open (CHANNELS_FILE);
+  if (file == NULL)
+    PANIC ("%s: open failed", CHANNELS_FILE);
+  for (i = 0; i < SWAP_PAGES; i++)
+    if (file_write (file, swap_page, PGSIZE) != PGSIZE)
+      PANIC ("%s: write failed", CHANNELS_FILE);
+  file_close (file);
+
+  start = timer_ticks ();
+  swap_pass ();
+  swap_ticks = timer_elapsed (start);
+  printf ("Swap writes alone: %lld ticks.\n", swap_ticks);
+
+  start = timer_ticks ();
+  file_pass ();
+  file_ticks = timer_elapsed (start);
+  printf ("File reads alone: %lld ticks.\n", file_ticks);
+
+  semaphore_init (&swap_done, 0);
+  start = timer_ticks ();
+  thread_create ("swap-bench", PRI_DEFAULT, swap_thread, &swap_done);
+  file_pass ();
+  semaphore_down (&swap_done);
+  both_ticks = timer_elapsed (start);
+  printf ("Both at once: %lld ticks, vs %lld one after the other.\n",
+          both_ticks, swap_ticks + file_ticks);
+
+  if (!filesys_remove (CHANNELS_FILE))
+    PANIC ("%s: remove failed", CHANNELS_FILE);
+  palloc_free_page (swap_page);
+  palloc_free_page (file_page);
+}
+
+/* Writes SWAP_PAGES pages to the swap device, one request per
+   page. */
+static void
+swap_pass (void)
+{
+  int i;
+
+  for (i = 0; i < SWAP_PAGES; i++)
+    block_write_multiple (swap_disk, i * SECTORS_PER_PAGE, SECTORS_PER_PAGE,
+                          swap_page);
+}
+
+/* Reads the benchmark file from start to end, a page at a time. */
+static void
+file_pass (void)
+{
+  struct file *file = filesys_open (CHANNELS_FILE);
+  int i;
+
+  if (file == NULL)
+    PANIC ("%s: open failed", CHANNELS_FILE);
+  for (i = 0; i < SWAP_PAGES; i++)
+    if (file_read (file, file_page, PGSIZE) != PGSIZE)
+      PANIC ("%s: read failed", CHANNELS_FILE);
+  file_close (file);
+}
+
+/* Runs swap_pass() and then ups the semaphore DONE_. */
+static void
+swap_thread (void *done_)
+{
+  swap_pass ();
+  semaphore_up (done_);
+}
+
+/* Counts in spin_cnt, yielding after each count, until spin_stop
+   is set. */
+static void
+spin (void *aux UNUSED)
+{
+  while (!spin_stop)
+    {
+      spin_cnt++;
+      thread_yield ();
+    }
+}
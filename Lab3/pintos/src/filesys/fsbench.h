@@ -0,0 +1,7 @@
+#ifndef FILESYS_FSBENCH_H
+#define FILESYS_FSBENCH_H
+
+void fsbench_ide (char **argv);
+void fsbench_channels (char **argv);
+
+#endif /* filesys/fsbench.h */
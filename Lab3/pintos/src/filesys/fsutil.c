@@ -1,5 +1,6 @@
 #include "filesys/fsutil.h"
 #include <debug.h>
+#include <round.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -67,6 +68,10 @@ fsutil_rm (char **argv)
     PANIC ("%s: delete failed\n", file_name);
 }
 
+/* Number of sectors that fsutil_extract() reads from the scratch
+   device at once: a page's worth. */
+#define EXTRACT_SECTORS (PGSIZE / BLOCK_SECTOR_SIZE)
+
 /* Extracts a ustar-format tar archive from the scratch block
    device into the Pintos file system. */
 void
@@ -79,7 +84,7 @@ fsutil_extract (char **argv UNUSED)
 
   /* Allocate buffers. */
   header = malloc (BLOCK_SECTOR_SIZE);
-  data = malloc (BLOCK_SECTOR_SIZE);
+  data = malloc (EXTRACT_SECTORS * BLOCK_SECTOR_SIZE);
   if (header == NULL || data == NULL)
     PANIC ("couldn't allocate buffers");
 
@@ -124,13 +129,15 @@ fsutil_extract (char **argv UNUSED)
           if (dst == NULL)
             PANIC ("%s: open failed", file_name);
 
-          /* Do copy. */
+          /* Do copy, up to EXTRACT_SECTORS sectors at a time. */
           while (size > 0)
             {
-              int chunk_size = (size > BLOCK_SECTOR_SIZE
-                                ? BLOCK_SECTOR_SIZE
+              int chunk_size = (size > EXTRACT_SECTORS * BLOCK_SECTOR_SIZE
+                                ? EXTRACT_SECTORS * BLOCK_SECTOR_SIZE
                                 : size);
-              block_read (src, sector++, data);
+              size_t sector_cnt = DIV_ROUND_UP (chunk_size, BLOCK_SECTOR_SIZE);
+              block_read_multiple (src, sector, sector_cnt, data);
+              sector += sector_cnt;
               if (file_write (dst, data, chunk_size) != chunk_size)
                 PANIC ("%s: write failed with %d bytes unwritten",
                        file_name, size);
@@ -1,4 +1,5 @@
 #include "filesys/inode.h"
+#include <hash.h>
 #include <list.h>
 #include <debug.h>
 #include <round.h>
@@ -6,34 +7,91 @@
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "filesys/cache.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/rwlock.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
 #define DIRECT_BLOCKS_COUNT 123
 #define INDIRECT_BLOCKS_PER_SECTOR 128
+#define EXTENTS_COUNT 41
+
+/* Block pointer of a hole, a part of a file that has never been
+   written: it reads as zeros, and gets a sector on its first write.
+   Sector 0 holds the free map, so it is never file data. */
+#define SECTOR_HOLE 0
+
+/* A run of LENGTH consecutive sectors starting at START, holding
+   the file's sectors from INDEX on. */
+struct inode_extent
+  {
+    uint32_t index;
+    block_sector_t start;
+    uint32_t length;
+  };
 
 /* On-disk inode.
-   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+   Must be exactly BLOCK_SECTOR_SIZE bytes long.
+
+   `format' sits in what used to be padding after `is_dir', which
+   inode_create() always zeroed, so inodes written before it
+   existed read as INODE_FORMAT_INDEXED. */
 struct inode_disk
   {
-    /** Data sectors */
-    block_sector_t direct_blocks[DIRECT_BLOCKS_COUNT];
-    block_sector_t indirect_block;
-    block_sector_t doubly_indirect_block;
+    union
+      {
+        /** Data sectors, for INODE_FORMAT_INDEXED */
+        struct
+          {
+            block_sector_t direct_blocks[DIRECT_BLOCKS_COUNT];
+            block_sector_t indirect_block;
+            block_sector_t doubly_indirect_block;
+          };
+
+        /** Data extents, in file order, for INODE_FORMAT_EXTENT.
+            Sectors between them are holes. */
+        struct
+          {
+            struct inode_extent extents[EXTENTS_COUNT];
+            uint32_t extent_cnt;
+          };
+      };
 
     bool is_dir;
+    uint8_t format;                     /* An enum inode_format. */
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
   };
 
+/* Format of newly created inodes. */
+static enum inode_format new_inode_format = INODE_FORMAT_EXTENT;
+
 struct inode_indirect_block_sector {
   block_sector_t blocks[INDIRECT_BLOCKS_PER_SECTOR];
 };
 
-static bool inode_allocate (struct inode_disk *disk_inode);
-static bool inode_reserve (struct inode_disk *disk_inode, off_t length);
+/* Decoded indirect blocks of an inode, so that translating a file
+   offset to a sector does not go through the buffer cache for
+   every sector of a large file.  Holds the single indirect block,
+   the top level of the doubly indirect block, and the most
+   recently used second-level block below it. */
+struct inode_block_map
+  {
+    bool indirect_valid;
+    block_sector_t indirect[INDIRECT_BLOCKS_PER_SECTOR];
+
+    bool doubly_valid;
+    block_sector_t doubly[INDIRECT_BLOCKS_PER_SECTOR];
+
+    off_t leaf_first;                   /* Index into `doubly', or -1. */
+    block_sector_t leaf[INDIRECT_BLOCKS_PER_SECTOR];
+  };
+
+static bool inode_reserve (struct inode_disk *disk_inode,
+                           struct inode_block_map *map,
+                           off_t offset, off_t size, bool *changed);
 static bool inode_deallocate (struct inode *inode);
 
 /* Returns the number of sectors to allocate for an inode SIZE
@@ -50,20 +108,115 @@ min (size_t a, size_t b)
   return a < b ? a : b;
 }
 
+/* Returns the buffer cache class of the data sectors of the file
+   that DISK_INODE describes. */
+static inline enum buffer_cache_class
+data_class (const struct inode_disk *disk_inode)
+{
+  return disk_inode->is_dir ? CACHE_DIR : CACHE_DATA;
+}
+
 /* In-memory inode. */
 struct inode
   {
-    struct list_elem elem;              /* Element in inode list. */
+    struct hash_elem elem;              /* Element in open_inodes. */
+    struct list_elem closed_elem;       /* Element in closed_inodes. */
     block_sector_t sector;              /* Sector number of disk location. */
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    struct rwlock rwlock;               /* Readers share, writers exclusive. */
+    struct rwlock dir_lock;             /* Directory entries, if a directory. */
+    struct lock map_lock;               /* Protects `map'. */
+    struct inode_block_map *map;        /* Decoded indirect blocks, or NULL. */
     struct inode_disk data;             /* Inode content. */
   };
 
+/* Copies the block pointers in indirect block SECTOR into BLOCKS.
+   A hole holds nothing but holes. */
+static void
+read_indirect (block_sector_t sector, block_sector_t *blocks)
+{
+  struct inode_indirect_block_sector *indirect_idisk;
+
+  if (sector == SECTOR_HOLE)
+    {
+      memset (blocks, 0, sizeof indirect_idisk->blocks);
+      return;
+    }
+  indirect_idisk = buffer_cache_pin (sector, true, CACHE_INDIRECT);
+  memcpy (blocks, indirect_idisk->blocks, sizeof indirect_idisk->blocks);
+  buffer_cache_unpin (indirect_idisk, false);
+}
+
+/* Returns block pointer I of indirect block SECTOR, read through
+   the buffer cache.  A hole holds nothing but holes. */
+static block_sector_t
+read_indirect_entry (block_sector_t sector, size_t i)
+{
+  struct inode_indirect_block_sector *indirect_idisk;
+  block_sector_t entry;
+
+  if (sector == SECTOR_HOLE)
+    return SECTOR_HOLE;
+  indirect_idisk = buffer_cache_pin (sector, true, CACHE_INDIRECT);
+  entry = indirect_idisk->blocks[i];
+  buffer_cache_unpin (indirect_idisk, false);
+  return entry;
+}
+
+/* Forgets INODE's decoded indirect blocks, after its block
+   pointers have changed in a way that inode_reserve() could not
+   record in them.  The caller must hold INODE's rwlock for
+   writing. */
+static void
+inode_map_invalidate (struct inode *inode)
+{
+  lock_acquire (&inode->map_lock);
+  if (inode->map != NULL)
+    {
+      inode->map->indirect_valid = false;
+      inode->map->doubly_valid = false;
+      inode->map->leaf_first = -1;
+    }
+  lock_release (&inode->map_lock);
+}
+
+/* Returns data sector INDEX of indexed inode IDISK, which lies past
+   its direct blocks, by going through its indirect blocks in the
+   buffer cache.  For when the inode's block map cannot be had. */
+static block_sector_t
+index_to_sector_uncached (const struct inode_disk *idisk, off_t index)
+{
+  index -= DIRECT_BLOCKS_COUNT;
+  if (index < INDIRECT_BLOCKS_PER_SECTOR)
+    return read_indirect_entry (idisk->indirect_block, index);
+  index -= INDIRECT_BLOCKS_PER_SECTOR;
+  if (index < INDIRECT_BLOCKS_PER_SECTOR * INDIRECT_BLOCKS_PER_SECTOR)
+    return read_indirect_entry (
+      read_indirect_entry (idisk->doubly_indirect_block,
+                           index / INDIRECT_BLOCKS_PER_SECTOR),
+      index % INDIRECT_BLOCKS_PER_SECTOR);
+  return -1;
+}
+
 static block_sector_t
-index_to_sector (const struct inode_disk *idisk, off_t index)
+index_to_sector (struct inode *inode, off_t index)
 {
+  const struct inode_disk *idisk = &inode->data;
+  struct inode_block_map *map;
+
+  if (idisk->format == INODE_FORMAT_EXTENT) {
+    uint32_t i;
+    for (i = 0; i < idisk->extent_cnt; ++ i) {
+      const struct inode_extent *e = &idisk->extents[i];
+      if ((uint32_t) index < e->index)
+        break;
+      if ((uint32_t) index < e->index + e->length)
+        return e->start + (index - e->index);
+    }
+    return SECTOR_HOLE;
+  }
   off_t index_base = 0, index_limit = 0;   // base, limit for sector index
   block_sector_t ret;
 
@@ -74,16 +227,30 @@ index_to_sector (const struct inode_disk *idisk, off_t index)
   }
   index_base = index_limit;
 
+  // past the direct blocks: go through the decoded block map
+  lock_acquire (&inode->map_lock);
+  map = inode->map;
+  if (map == NULL) {
+    map = inode->map = malloc (sizeof *map);
+    if (map == NULL) {
+      // out of memory: do without the map, and try again next time
+      lock_release (&inode->map_lock);
+      return index_to_sector_uncached (idisk, index);
+    }
+    map->indirect_valid = map->doubly_valid = false;
+    map->leaf_first = -1;
+  }
+
   // (2) a single indirect block
   index_limit += 1 * INDIRECT_BLOCKS_PER_SECTOR;
   if (index < index_limit) {
-    struct inode_indirect_block_sector *indirect_idisk;
-    indirect_idisk = calloc(1, sizeof(struct inode_indirect_block_sector));
-    buffer_cache_read (idisk->indirect_block, indirect_idisk);
-
-    ret = indirect_idisk->blocks[ index - index_base ];
-    free(indirect_idisk);
+    if (!map->indirect_valid) {
+      read_indirect (idisk->indirect_block, map->indirect);
+      map->indirect_valid = true;
+    }
+    ret = map->indirect[ index - index_base ];
 
+    lock_release (&inode->map_lock);
     return ret;
   }
   index_base = index_limit;
@@ -95,48 +262,89 @@ index_to_sector (const struct inode_disk *idisk, off_t index)
     off_t index_first =  (index - index_base) / INDIRECT_BLOCKS_PER_SECTOR;
     off_t index_second = (index - index_base) % INDIRECT_BLOCKS_PER_SECTOR;
 
-    // fetch two indirect block sectors
-    struct inode_indirect_block_sector *indirect_idisk;
-    indirect_idisk = calloc(1, sizeof(struct inode_indirect_block_sector));
-
-    buffer_cache_read (idisk->doubly_indirect_block, indirect_idisk);
-    buffer_cache_read (indirect_idisk->blocks[index_first], indirect_idisk);
-    ret = indirect_idisk->blocks[index_second];
+    // look up through two indirect block sectors
+    if (!map->doubly_valid) {
+      read_indirect (idisk->doubly_indirect_block, map->doubly);
+      map->doubly_valid = true;
+    }
+    if (map->leaf_first != index_first) {
+      read_indirect (map->doubly[index_first], map->leaf);
+      map->leaf_first = index_first;
+    }
+    ret = map->leaf[index_second];
 
-    free(indirect_idisk);
+    lock_release (&inode->map_lock);
     return ret;
   }
 
   // (4) what up?
+  lock_release (&inode->map_lock);
   return -1;
 }
 
 /* Returns the block device sector that contains byte offset POS
-   within INODE.
+   within INODE, or SECTOR_HOLE if that part of INODE is a hole.
    Returns -1 if INODE does not contain data for a byte at offset
    POS. */
 static block_sector_t
-byte_to_sector (const struct inode *inode, off_t pos)
+byte_to_sector (struct inode *inode, off_t pos)
 {
   ASSERT (inode != NULL);
   if (0 <= pos && pos < inode->data.length) {
     // sector index
     off_t index = pos / BLOCK_SECTOR_SIZE;
-    return index_to_sector (&inode->data, index);
+    return index_to_sector (inode, index);
   }
   else
     return -1;
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+/* Open inodes, hashed by sector, so that opening a single inode
+   twice returns the same `struct inode'.  Searching it only needs
+   the lock for reading; adding or removing an inode, or reviving
+   a closed one, needs it for writing. */
+static struct hash open_inodes;
+static struct rwlock open_inodes_lock;
+
+/* Up to CLOSED_INODES_MAX inodes that nobody has open any more stay
+   in open_inodes with an open count of 0, so that reopening them
+   does not read the inode from disk again.  They are kept on this
+   list, least recently closed first, and freed from its front.
+   Protected by open_inodes_lock. */
+#define CLOSED_INODES_MAX 32
+static struct list closed_inodes;
+static size_t closed_inode_cnt;
+
+static struct inode *open_inodes_find (block_sector_t);
+static hash_hash_func inode_hash;
+static hash_less_func inode_less;
+static void inode_free (struct inode *);
 
 /* Initializes the inode module. */
 void
 inode_init (void)
 {
-  list_init (&open_inodes);
+  hash_init (&open_inodes, inode_hash, inode_less, NULL);
+  rwlock_init (&open_inodes_lock);
+  list_init (&closed_inodes);
+  closed_inode_cnt = 0;
+}
+
+/* Returns a hash value for inode E. */
+static unsigned
+inode_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct inode *inode = hash_entry (e, struct inode, elem);
+  return hash_int (inode->sector);
+}
+
+/* Returns true if inode A precedes inode B. */
+static bool
+inode_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return hash_entry (a, struct inode, elem)->sector
+         < hash_entry (b, struct inode, elem)->sector;
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -162,62 +370,127 @@ inode_create (block_sector_t sector, off_t length, bool is_dir)
       disk_inode->length = length;
       disk_inode->magic = INODE_MAGIC;
       disk_inode->is_dir = is_dir;
-      if (inode_allocate (disk_inode))
-        {
-          buffer_cache_write (sector, disk_inode);
-          success = true;
-        }
+      disk_inode->format = new_inode_format;
+
+      /* All of the data starts out as a hole. */
+      buffer_cache_write (sector, disk_inode, CACHE_INODE);
+      success = true;
       free (disk_inode);
     }
   return success;
 }
 
+/* Selects the on-disk format of inodes created from now on. */
+void
+inode_set_format (enum inode_format format)
+{
+  new_inode_format = format;
+}
+
+/* Returns the on-disk format of INODE. */
+enum inode_format
+inode_get_format (const struct inode *inode)
+{
+  return inode->data.format;
+}
+
 /* Reads an inode from SECTOR
    and returns a `struct inode' that contains it.
    Returns a null pointer if memory allocation fails. */
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
   struct inode *inode;
 
-  /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e))
+  /* Check whether this inode is already open.  A closed inode has
+     to be taken off closed_inodes, which needs the lock for
+     writing. */
+  rwlock_acquire_read (&open_inodes_lock);
+  inode = open_inodes_find (sector);
+  if (inode != NULL && inode->open_cnt > 0)
+    inode_reopen (inode);
+  else
+    inode = NULL;
+  rwlock_release_read (&open_inodes_lock);
+  if (inode != NULL)
+    return inode;
+
+  /* Check again, now exclusively, since another thread may have
+     opened or closed it in the meantime. */
+  rwlock_acquire_write (&open_inodes_lock);
+  inode = open_inodes_find (sector);
+  if (inode != NULL)
     {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector)
+      if (inode->open_cnt == 0)
         {
-          inode_reopen (inode);
-          return inode;
+          list_remove (&inode->closed_elem);
+          closed_inode_cnt--;
         }
+      inode_reopen (inode);
+      goto done;
     }
 
   /* Allocate memory. */
   inode = malloc (sizeof *inode);
   if (inode == NULL)
-    return NULL;
+    goto done;
 
   /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
   inode->sector = sector;
+  hash_insert (&open_inodes, &inode->elem);
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
+  rwlock_init (&inode->rwlock);
+  rwlock_init (&inode->dir_lock);
+  lock_init (&inode->map_lock);
+  inode->map = NULL;
+
+  buffer_cache_read (inode->sector, &inode->data, CACHE_INODE);
 
-  buffer_cache_read (inode->sector, &inode->data);
+ done:
+  rwlock_release_write (&open_inodes_lock);
   return inode;
 }
 
+/* Returns the open or recently closed inode for SECTOR, or a null
+   pointer if there is none.  Must be called with open_inodes_lock
+   held. */
+static struct inode *
+open_inodes_find (block_sector_t sector)
+{
+  struct inode key;
+  struct hash_elem *e;
+
+  key.sector = sector;
+  e = hash_find (&open_inodes, &key.elem);
+  return e != NULL ? hash_entry (e, struct inode, elem) : NULL;
+}
+
 /* Reopens and returns INODE. */
 struct inode *
 inode_reopen (struct inode *inode)
 {
+  /* Several threads may reopen INODE at once while holding
+     open_inodes_lock for reading. */
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      enum intr_level old_level = intr_disable ();
+      inode->open_cnt++;
+      intr_set_level (old_level);
+    }
   return inode;
 }
 
+/* Returns the lock that protects the entries of directory
+   INODE: dir_lookup() holds it for reading, dir_add() and
+   dir_remove() for writing. */
+struct rwlock *
+inode_dir_lock (struct inode *inode)
+{
+  return &inode->dir_lock;
+}
+
 /* Returns INODE's inode number. */
 block_sector_t
 inode_get_inumber (const struct inode *inode)
@@ -226,8 +499,9 @@ inode_get_inumber (const struct inode *inode)
 }
 
 /* Closes INODE and writes it to disk.
-   If this was the last reference to INODE, frees its memory.
-   If INODE was also a removed inode, frees its blocks. */
+   If this was the last reference to INODE, it is kept in memory
+   among the recently closed inodes, unless it was a removed inode,
+   in which case its memory and blocks are freed. */
 void
 inode_close (struct inode *inode)
 {
@@ -235,21 +509,57 @@ inode_close (struct inode *inode)
   if (inode == NULL)
     return;
 
-  /* Release resources if this was the last opener. */
-  if (--inode->open_cnt == 0)
+  /* Release resources if this was the last opener.  The count is
+     updated with interrupts off to keep it consistent with
+     inode_reopen(), which may run without the lock. */
+  rwlock_acquire_write (&open_inodes_lock);
+  enum intr_level old_level = intr_disable ();
+  int open_cnt = --inode->open_cnt;
+  intr_set_level (old_level);
+  if (open_cnt > 0)
+    {
+      rwlock_release_write (&open_inodes_lock);
+      return;
+    }
+
+  /* Keep the inode around in case it is opened again soon, unless
+     it is being deleted, making room by freeing the one that has
+     been closed the longest. */
+  if (!inode->removed)
     {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
+      struct inode *victim = NULL;
 
-      /* Deallocate blocks if removed. */
-      if (inode->removed)
+      list_push_back (&closed_inodes, &inode->closed_elem);
+      if (++closed_inode_cnt > CLOSED_INODES_MAX)
         {
-          free_map_release (inode->sector, 1);
-          inode_deallocate (inode);
+          victim = list_entry (list_pop_front (&closed_inodes),
+                               struct inode, closed_elem);
+          hash_delete (&open_inodes, &victim->elem);
+          closed_inode_cnt--;
         }
-
-      free (inode);
+      rwlock_release_write (&open_inodes_lock);
+      if (victim != NULL)
+        inode_free (victim);
+      return;
     }
+
+  /* Remove from inode table and release lock. */
+  hash_delete (&open_inodes, &inode->elem);
+  rwlock_release_write (&open_inodes_lock);
+
+  /* Deallocate blocks. */
+  free_map_release (inode->sector, 1);
+  inode_deallocate (inode);
+  inode_free (inode);
+}
+
+/* Frees the memory of INODE, which nobody has open and which is
+   no longer in open_inodes. */
+static void
+inode_free (struct inode *inode)
+{
+  free (inode->map);
+  free (inode);
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -269,8 +579,8 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
 
+  rwlock_acquire_read (&inode->rwlock);
   while (size > 0)
     {
       /* Disk sector to read, starting byte offset within sector. */
@@ -287,23 +597,16 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Read full sector directly into caller's buffer. */
-          buffer_cache_read (sector_idx, buffer + bytes_read);
-        }
+      /* Copy straight out of the cached sector.  Holes read as
+         zeros without going to the cache at all. */
+      if (sector_idx == SECTOR_HOLE)
+        memset (buffer + bytes_read, 0, chunk_size);
       else
         {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL)
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-          buffer_cache_read (sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
+          uint8_t *data = buffer_cache_pin (sector_idx, true,
+                                            data_class (&inode->data));
+          memcpy (buffer + bytes_read, data + sector_ofs, chunk_size);
+          buffer_cache_unpin (data, false);
         }
 
       /* Advance. */
@@ -311,11 +614,33 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  free (bounce);
+  rwlock_release_read (&inode->rwlock);
 
   return bytes_read;
 }
 
+/* Starts bringing the sectors that hold SIZE bytes of INODE,
+   starting at OFFSET, into the buffer cache in the background.
+   Bytes past the end of INODE are ignored. */
+void
+inode_read_ahead (struct inode *inode, off_t offset, off_t size)
+{
+  off_t end;
+
+  rwlock_acquire_read (&inode->rwlock);
+  end = offset + size;
+  if (end > inode_length (inode))
+    end = inode_length (inode);
+  for (offset = ROUND_DOWN (offset, BLOCK_SECTOR_SIZE); offset < end;
+       offset += BLOCK_SECTOR_SIZE)
+    {
+      block_sector_t sector = byte_to_sector (inode, offset);
+      if (sector != -1u && sector != SECTOR_HOLE)
+        buffer_cache_prefetch (sector);
+    }
+  rwlock_release_read (&inode->rwlock);
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
    less than SIZE if end of file is reached or an error occurs.
@@ -327,27 +652,35 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
+  off_t old_length;
+  bool changed = false;
 
-  if (inode->deny_write_cnt)
+  if (inode->deny_write_cnt || size <= 0)
     return 0;
 
-  // beyond the EOF: extend the file
-  if( byte_to_sector(inode, offset + size - 1) == -1u ) {
-    // extend and reserve up to [offset + size] bytes
-    bool success;
-    success = inode_reserve (& inode->data, offset + size);
-    if (!success) return 0;  // fail?
-
-    // write back the (extended) file size
+  rwlock_acquire_write (&inode->rwlock);
+
+  // allocate the holes that this write fills in, recording the new
+  // block pointers in the block map as it goes. If the disk fills
+  // up, or the file would outgrow its largest size, the sectors
+  // before the first hole left still get written, but what was
+  // allocated on the way to the failure is not in the map.
+  if (! inode_reserve (& inode->data, inode->map, offset, size, &changed)
+      && changed)
+    inode_map_invalidate (inode);
+
+  // beyond the EOF: extend the file. Whatever lies between the old
+  // EOF and `offset` stays a hole.
+  old_length = inode->data.length;
+  if (offset + size > old_length)
     inode->data.length = offset + size;
-    buffer_cache_write (inode->sector, & inode->data);
-  }
 
   while (size > 0)
     {
       /* Sector to write, starting byte offset within sector. */
       block_sector_t sector_idx = byte_to_sector (inode, offset);
+      if (sector_idx == SECTOR_HOLE || sector_idx == (block_sector_t) -1)
+        break;
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
@@ -360,38 +693,29 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Write full sector directly to disk. */
-          buffer_cache_write (sector_idx, buffer + bytes_written);
-        }
-      else
-        {
-          /* We need a bounce buffer. */
-          if (bounce == NULL)
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left)
-            buffer_cache_read (sector_idx, bounce);
-          else
-            memset (bounce, 0, BLOCK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          buffer_cache_write (sector_idx, bounce);
-        }
+      /* Copy straight into the cached sector.  If the sector
+         contains data before or after the chunk we're writing,
+         then it needs to be read in first.  Otherwise the whole
+         sector is overwritten. */
+      bool partial = sector_ofs > 0 || chunk_size < sector_left;
+      uint8_t *data = buffer_cache_pin (sector_idx, partial,
+                                        data_class (&inode->data));
+      memcpy (data + sector_ofs, buffer + bytes_written, chunk_size);
+      buffer_cache_unpin (data, true);
 
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_written += chunk_size;
     }
-  free (bounce);
+
+  // write back the (extended) file size and block pointers
+  if (inode->data.length > old_length && offset < inode->data.length)
+    inode->data.length = bytes_written > 0 && offset > old_length
+                         ? offset : old_length;
+  if (changed || inode->data.length != old_length)
+    buffer_cache_write (inode->sector, & inode->data, CACHE_INODE);
+  rwlock_release_write (&inode->rwlock);
 
   return bytes_written;
 }
@@ -437,95 +761,274 @@ inode_is_removed (const struct inode *inode)
   return inode->removed;
 }
 
-static
-bool inode_allocate (struct inode_disk *disk_inode)
+/* Returns true if the write of SIZE bytes at OFFSET leaves part of
+   sector number INDEX of the file alone, so that a newly allocated
+   sector there has to be zeroed first. */
+static bool
+partly_written (size_t index, off_t offset, off_t size)
 {
-  return inode_reserve (disk_inode, disk_inode->length);
+  off_t start = (off_t) index * BLOCK_SECTOR_SIZE;
+  return start < offset || start + BLOCK_SECTOR_SIZE > offset + size;
 }
 
+/**
+ * Makes sure that the block pointer `*p_entry`, which is `level`
+ * levels of indirection above the data, points to a sector, as well
+ * as the data sector number `index` below it. New indirect blocks
+ * are zeroed, so that they hold only holes; a new data sector only
+ * if `zero`. Sets `*changed` if `*p_entry` itself was a hole.
+ * On success, stores the sectors on the way down, from `*p_entry`
+ * to the data sector, into `path[0]` through `path[level]`.
+ */
 static bool
-inode_reserve_indirect (block_sector_t* p_entry, size_t num_sectors, int level)
+inode_reserve_block (block_sector_t *p_entry, size_t index, int level,
+                     bool zero, bool *changed, block_sector_t *path)
 {
   static char zeros[BLOCK_SECTOR_SIZE];
 
   // only supports 2-level indirect block scheme as of now
   ASSERT (level <= 2);
 
-  if (level == 0) {
-    // base case : allocate a single sector if necessary and put it into the block
-    if (*p_entry == 0) {
-      if(! free_map_allocate (1, p_entry))
-        return false;
-      buffer_cache_write (*p_entry, zeros);
-    }
-    return true;
+  if (*p_entry == SECTOR_HOLE) {
+    if(! free_map_allocate (1, p_entry))
+      return false;
+    if (level > 0 || zero)
+      buffer_cache_write (*p_entry, zeros,
+                          level > 0 ? CACHE_INDIRECT : CACHE_DATA);
+    *changed = true;
   }
+  path[0] = *p_entry;
+  if (level == 0)
+    return true;
+
+  // update the block pointers in place in the cache
+  struct inode_indirect_block_sector *indirect_block;
+  size_t unit = (level == 1 ? 1 : INDIRECT_BLOCKS_PER_SECTOR);
+  bool success, dirty = false;
+
+  indirect_block = buffer_cache_pin (*p_entry, true, CACHE_INDIRECT);
+  success = inode_reserve_block (& indirect_block->blocks[index / unit],
+                                 index % unit, level - 1, zero, &dirty,
+                                 path + 1);
+  buffer_cache_unpin (indirect_block, dirty);
+  *changed = *changed || dirty;
+  return success;
+}
+
+/**
+ * Frees up an extent of an INODE_FORMAT_EXTENT inode by moving the
+ * two neighbouring extents that span the fewest sectors, holes in
+ * between included, into a single newly allocated run. The holes
+ * between them are zeroed. Returns false if no such run is free.
+ */
+static bool
+inode_coalesce_extents (struct inode_disk *disk_inode)
+{
+  static char zeros[BLOCK_SECTOR_SIZE];
+  enum buffer_cache_class cls = data_class (disk_inode);
+  struct inode_extent *a, *b;
+  uint32_t i, best = 0, span, best_span = UINT32_MAX;
+  block_sector_t start;
 
-  struct inode_indirect_block_sector indirect_block;
-  if(*p_entry == 0) {
-    // not yet allocated: allocate it, and fill with zero
-    free_map_allocate (1, p_entry);
-    buffer_cache_write (*p_entry, zeros);
+  if (disk_inode->extent_cnt < 2)
+    return false;
+  for (i = 0; i + 1 < disk_inode->extent_cnt; ++ i) {
+    a = &disk_inode->extents[i];
+    span = a[1].index + a[1].length - a->index;
+    if (span < best_span) {
+      best = i;
+      best_span = span;
+    }
   }
-  buffer_cache_read(*p_entry, &indirect_block);
 
-  size_t unit = (level == 1 ? 1 : INDIRECT_BLOCKS_PER_SECTOR);
-  size_t i, l = DIV_ROUND_UP (num_sectors, unit);
+  a = &disk_inode->extents[best];
+  b = a + 1;
+  if (!free_map_allocate (best_span, &start))
+    return false;
 
-  for (i = 0; i < l; ++ i) {
-    size_t subsize = min(num_sectors, unit);
-    if(! inode_reserve_indirect (& indirect_block.blocks[i], subsize, level - 1))
-      return false;
-    num_sectors -= subsize;
+  for (i = 0; i < best_span; ++ i) {
+    uint32_t index = a->index + i;
+    block_sector_t from;
+
+    if (index < a->index + a->length)
+      from = a->start + i;
+    else if (index >= b->index)
+      from = b->start + (index - b->index);
+    else {
+      buffer_cache_write (start + i, zeros, cls);
+      continue;
+    }
+    void *src = buffer_cache_pin (from, true, cls);
+    void *dst = buffer_cache_pin (start + i, false, cls);
+    memcpy (dst, src, BLOCK_SECTOR_SIZE);
+    buffer_cache_unpin (dst, true);
+    buffer_cache_unpin (src, false);
   }
 
-  ASSERT (num_sectors == 0);
-  buffer_cache_write (*p_entry, &indirect_block);
+  free_map_release (a->start, a->length);
+  free_map_release (b->start, b->length);
+  a->start = start;
+  a->length = best_span;
+  memmove (b, b + 1, (disk_inode->extent_cnt - best - 2) * sizeof *b);
+  disk_inode->extent_cnt --;
   return true;
 }
 
 /**
- * Extend inode blocks, so that the file can hold at least
- * `length` bytes.
+ * Allocates the holes in sectors `first` through `last` of an
+ * INODE_FORMAT_EXTENT inode, for a write of `size` bytes at
+ * `offset`. A run of holes right after an extent grows that extent
+ * in place while the sectors after it on disk are free; otherwise
+ * the largest run of free sectors, up to what is needed, becomes a
+ * new extent. When all extents are in use, neighbouring ones are
+ * coalesced to make room.
  */
 static bool
-inode_reserve (struct inode_disk *disk_inode, off_t length)
+inode_reserve_extents (struct inode_disk *disk_inode, size_t first,
+                       size_t last, off_t offset, off_t size, bool *changed)
 {
   static char zeros[BLOCK_SECTOR_SIZE];
-  if (length < 0) return false;
+  size_t index = first;
+  uint32_t i = 0;
+
+  while (index <= last) {
+    struct inode_extent *e = &disk_inode->extents[i];
+    size_t end = last + 1, cnt = 0, k;
+    block_sector_t start;
+
+    // skip the extents before `index`, and the part of it covered
+    if (i < disk_inode->extent_cnt && e->index + e->length <= index) {
+      ++ i;
+      continue;
+    }
+    if (i < disk_inode->extent_cnt && e->index <= index) {
+      index = e->index + e->length;
+      continue;
+    }
 
-  // (remaining) number of sectors, occupied by this file.
-  size_t num_sectors = bytes_to_sectors(length);
-  size_t i, l;
+    // holes from `index` up to the next extent or `last`
+    if (i < disk_inode->extent_cnt && e->index < end)
+      end = e->index;
 
-  // (1) direct blocks
-  l = min(num_sectors, DIRECT_BLOCKS_COUNT * 1);
-  for (i = 0; i < l; ++ i) {
-    if (disk_inode->direct_blocks[i] == 0) { // unoccupied
-      if(! free_map_allocate (1, &disk_inode->direct_blocks[i]))
-        return false;
-      buffer_cache_write (disk_inode->direct_blocks[i], zeros);
+    if (i > 0 && e[-1].index + e[-1].length == index) {
+      start = e[-1].start + e[-1].length;
+      cnt = free_map_allocate_at (start, end - index);
+      e[-1].length += cnt;
+    }
+    if (cnt == 0) {
+      if (disk_inode->extent_cnt == EXTENTS_COUNT) {
+        // out of extents: make room, then start over, since the
+        // extents have moved and may even cover `index` now
+        if (!inode_coalesce_extents (disk_inode))
+          return false;
+        *changed = true;
+        i = 0;
+        continue;
+      }
+      cnt = end - index;
+      while (!free_map_allocate (cnt, &start)) {
+        if (cnt == 1)
+          return false;
+        cnt /= 2;
+      }
+      memmove (e + 1, e, (disk_inode->extent_cnt - i) * sizeof *e);
+      e->index = index;
+      e->start = start;
+      e->length = cnt;
+      disk_inode->extent_cnt ++;
+      ++ i;
+    }
+    *changed = true;
+
+    for (k = 0; k < cnt; ++ k)
+      if (partly_written (index + k, offset, size))
+        buffer_cache_write (start + k, zeros, data_class (disk_inode));
+    index += cnt;
+
+    // merge with the next extent if the two now touch on disk too
+    e = &disk_inode->extents[i - 1];
+    if (i < disk_inode->extent_cnt
+        && e->index + e->length == e[1].index
+        && e->start + e->length == e[1].start) {
+      e->length += e[1].length;
+      memmove (e + 1, e + 2,
+               (disk_inode->extent_cnt - i - 1) * sizeof *e);
+      disk_inode->extent_cnt --;
     }
   }
-  num_sectors -= l;
-  if(num_sectors == 0) return true;
+  return true;
+}
 
-  // (2) a single indirect block
-  l = min(num_sectors, 1 * INDIRECT_BLOCKS_PER_SECTOR);
-  if(! inode_reserve_indirect (& disk_inode->indirect_block, l, 1))
-    return false;
-  num_sectors -= l;
-  if(num_sectors == 0) return true;
+/**
+ * Allocates the holes among the sectors that hold bytes `offset`
+ * through `offset + size - 1` of the file, in ascending order, and
+ * sets `*changed` if there were any. Sectors that the write will
+ * only partly cover are zeroed; the others are left for the write
+ * to fill. Returns false if the disk filled up first.
+ *
+ * The block pointers of an indexed inode are also recorded in `map`,
+ * its decoded indirect blocks, unless that is NULL, so that the map
+ * stays valid without reading the indirect blocks in again. The
+ * caller must hold the inode's rwlock for writing, which keeps
+ * everyone else from using the map meanwhile.
+ */
+static bool
+inode_reserve (struct inode_disk *disk_inode, struct inode_block_map *map,
+               off_t offset, off_t size, bool *changed)
+{
+  size_t first = offset / BLOCK_SECTOR_SIZE;
+  size_t last = (offset + size - 1) / BLOCK_SECTOR_SIZE;
+  size_t index;
+  block_sector_t path[3];
+
+  if (offset < 0 || size <= 0) return false;
+  if (disk_inode->format == INODE_FORMAT_EXTENT)
+    return inode_reserve_extents (disk_inode, first, last, offset, size,
+                                  changed);
+
+  for (index = first; index <= last; ++ index) {
+    bool zero = partly_written (index, offset, size);
+    size_t i = index;
+
+    // (1) direct blocks
+    if (i < DIRECT_BLOCKS_COUNT) {
+      if (! inode_reserve_block (& disk_inode->direct_blocks[i], 0, 0,
+                                 zero, changed, path))
+        return false;
+      continue;
+    }
+    i -= DIRECT_BLOCKS_COUNT;
 
-  // (3) a single doubly indirect block
-  l = min(num_sectors, 1 * INDIRECT_BLOCKS_PER_SECTOR * INDIRECT_BLOCKS_PER_SECTOR);
-  if(! inode_reserve_indirect (& disk_inode->doubly_indirect_block, l, 2))
-    return false;
-  num_sectors -= l;
-  if(num_sectors == 0) return true;
+    // (2) a single indirect block
+    if (i < INDIRECT_BLOCKS_PER_SECTOR) {
+      if (! inode_reserve_block (& disk_inode->indirect_block, i, 1,
+                                 zero, changed, path))
+        return false;
+      if (map != NULL && map->indirect_valid)
+        map->indirect[i] = path[1];
+      continue;
+    }
+    i -= INDIRECT_BLOCKS_PER_SECTOR;
 
-  ASSERT (num_sectors == 0);
-  return false;
+    // (3) a single doubly indirect block
+    if (i < INDIRECT_BLOCKS_PER_SECTOR * INDIRECT_BLOCKS_PER_SECTOR) {
+      if (! inode_reserve_block (& disk_inode->doubly_indirect_block, i, 2,
+                                 zero, changed, path))
+        return false;
+      if (map != NULL) {
+        off_t index_first = i / INDIRECT_BLOCKS_PER_SECTOR;
+        if (map->doubly_valid)
+          map->doubly[index_first] = path[1];
+        if (map->leaf_first == index_first)
+          map->leaf[i % INDIRECT_BLOCKS_PER_SECTOR] = path[2];
+      }
+      continue;
+    }
+
+    // (4) past the largest file size
+    return false;
+  }
+  return true;
 }
 
 static void
@@ -534,24 +1037,27 @@ inode_deallocate_indirect (block_sector_t entry, size_t num_sectors, int level)
   // only supports 2-level indirect block scheme as of now
   ASSERT (level <= 2);
 
+  if (entry == SECTOR_HOLE)
+    return;
   if (level == 0) {
     free_map_release (entry, 1);
     return;
   }
 
-  struct inode_indirect_block_sector indirect_block;
-  buffer_cache_read(entry, &indirect_block);
+  struct inode_indirect_block_sector *indirect_block;
+  indirect_block = buffer_cache_pin (entry, true, CACHE_INDIRECT);
 
   size_t unit = (level == 1 ? 1 : INDIRECT_BLOCKS_PER_SECTOR);
   size_t i, l = DIV_ROUND_UP (num_sectors, unit);
 
   for (i = 0; i < l; ++ i) {
     size_t subsize = min(num_sectors, unit);
-    inode_deallocate_indirect (indirect_block.blocks[i], subsize, level - 1);
+    inode_deallocate_indirect (indirect_block->blocks[i], subsize, level - 1);
     num_sectors -= subsize;
   }
 
   ASSERT (num_sectors == 0);
+  buffer_cache_unpin (indirect_block, false);
   free_map_release (entry, 1);
 }
 
@@ -561,6 +1067,14 @@ bool inode_deallocate (struct inode *inode)
   off_t file_length = inode->data.length; // bytes
   if(file_length < 0) return false;
 
+  if (inode->data.format == INODE_FORMAT_EXTENT) {
+    uint32_t e;
+    for (e = 0; e < inode->data.extent_cnt; ++ e)
+      free_map_release (inode->data.extents[e].start,
+                        inode->data.extents[e].length);
+    return true;
+  }
+
   // (remaining) number of sectors, occupied by this file.
   size_t num_sectors = bytes_to_sectors(file_length);
   size_t i, l;
@@ -568,7 +1082,8 @@ bool inode_deallocate (struct inode *inode)
   // (1) direct blocks
   l = min(num_sectors, DIRECT_BLOCKS_COUNT * 1);
   for (i = 0; i < l; ++ i) {
-    free_map_release (inode->data.direct_blocks[i], 1);
+    if (inode->data.direct_blocks[i] != SECTOR_HOLE)
+      free_map_release (inode->data.direct_blocks[i], 1);
   }
   num_sectors -= l;
 
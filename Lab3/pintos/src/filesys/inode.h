@@ -6,6 +6,18 @@
 #include "devices/block.h"
 
 struct bitmap;
+struct inode;
+struct rwlock;
+
+/* On-disk inode formats. */
+enum inode_format
+  {
+    INODE_FORMAT_INDEXED = 0,   /* Direct, indirect, doubly indirect. */
+    INODE_FORMAT_EXTENT = 1     /* (start, length) runs of sectors. */
+  };
+
+void inode_set_format (enum inode_format);
+enum inode_format inode_get_format (const struct inode *);
 
 void inode_init (void);
 bool inode_create (block_sector_t, off_t, bool);
@@ -15,11 +27,13 @@ block_sector_t inode_get_inumber (const struct inode *);
 void inode_close (struct inode *);
 void inode_remove (struct inode *);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
+void inode_read_ahead (struct inode *, off_t offset, off_t size);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
 off_t inode_length (const struct inode *);
 bool inode_is_directory (const struct inode *);
 bool inode_is_removed (const struct inode *);
+struct rwlock *inode_dir_lock (struct inode *);
 
 #endif /* filesys/inode.h */
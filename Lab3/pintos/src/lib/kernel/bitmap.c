@@ -69,6 +69,65 @@ last_mask (const struct bitmap *b)
   return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
 
+/* Returns an elem_type in which bits LO through HI - 1 are set
+   to 1 and the rest are set to 0.  Requires LO < HI <= ELEM_BITS. */
+static inline elem_type
+range_mask (size_t lo, size_t hi)
+{
+  elem_type high = hi < ELEM_BITS ? ((elem_type) 1 << hi) - 1 : (elem_type) -1;
+  return high & ~(((elem_type) 1 << lo) - 1);
+}
+
+/* Returns the number of bits set to 1 in X.  Done by hand because
+   the kernel is not linked with libgcc, which is where
+   __builtin_popcount() would otherwise end up. */
+static inline size_t
+popcount (elem_type x)
+{
+  x = x - ((x >> 1) & (elem_type) 0x55555555);
+  x = (x & (elem_type) 0x33333333) + ((x >> 2) & (elem_type) 0x33333333);
+  x = (x + (x >> 4)) & (elem_type) 0x0f0f0f0f;
+  return (x * (elem_type) 0x01010101) >> (ELEM_BITS - 8);
+}
+
+/* Returns the index of the first bit in B between START and END,
+   exclusive, that is set to VALUE, or END if there is none.
+   Elements that cannot contain a match are skipped whole. */
+static size_t
+next_bit (const struct bitmap *b, size_t start, size_t end, bool value)
+{
+  elem_type flip = value ? 0 : (elem_type) -1;
+  size_t idx, last_idx;
+  elem_type e;
+
+  if (start >= end)
+    return end;
+
+  idx = elem_idx (start);
+  last_idx = elem_idx (end - 1);
+  e = (b->bits[idx] ^ flip) & ~(bit_mask (start) - 1);
+  while (e == 0)
+    {
+      if (++idx > last_idx)
+        return end;
+      e = b->bits[idx] ^ flip;
+    }
+
+  start = idx * ELEM_BITS + __builtin_ctzl (e);
+  return start < end ? start : end;
+}
+
+/* Sets the bits of MASK in *E to VALUE.  Like bitmap_mark() and
+   bitmap_reset(), this is atomic on a uniprocessor machine. */
+static inline void
+elem_set_mask (elem_type *e, elem_type mask, bool value)
+{
+  if (value)
+    asm ("orl %1, %0" : "=m" (*e) : "r" (mask) : "cc");
+  else
+    asm ("andl %1, %0" : "=m" (*e) : "r" (~mask) : "cc");
+}
+
 /* Creation and destruction. */
 
 /* Creates and returns a pointer to a newly allocated bitmap with room for
@@ -217,14 +276,34 @@ bitmap_set_all (struct bitmap *b, bool value)
 void
 bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
-  
+  size_t end = start + cnt;
+  size_t idx, last_idx;
+
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    bitmap_set (b, start + i, value);
+  if (cnt == 0)
+    return;
+
+  idx = elem_idx (start);
+  last_idx = elem_idx (end - 1);
+  if (idx == last_idx)
+    {
+      elem_set_mask (&b->bits[idx],
+                     range_mask (start % ELEM_BITS,
+                                 end - last_idx * ELEM_BITS), value);
+      return;
+    }
+
+  /* Partial first element, whole middle elements, partial last
+     element. */
+  elem_set_mask (&b->bits[idx], range_mask (start % ELEM_BITS, ELEM_BITS),
+                 value);
+  for (idx++; idx < last_idx; idx++)
+    b->bits[idx] = value ? (elem_type) -1 : 0;
+  elem_set_mask (&b->bits[last_idx],
+                 range_mask (0, end - last_idx * ELEM_BITS), value);
 }
 
 /* Returns the number of bits in B between START and START + CNT,
@@ -232,17 +311,32 @@ bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value)
 size_t
 bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i, value_cnt;
+  size_t end = start + cnt;
+  size_t idx, last_idx, ones;
 
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  value_cnt = 0;
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      value_cnt++;
-  return value_cnt;
+  if (cnt == 0)
+    return 0;
+
+  idx = elem_idx (start);
+  last_idx = elem_idx (end - 1);
+  if (idx == last_idx)
+    ones = popcount (b->bits[idx]
+                     & range_mask (start % ELEM_BITS,
+                                   end - last_idx * ELEM_BITS));
+  else
+    {
+      ones = popcount (b->bits[idx]
+                       & range_mask (start % ELEM_BITS, ELEM_BITS));
+      for (idx++; idx < last_idx; idx++)
+        ones += popcount (b->bits[idx]);
+      ones += popcount (b->bits[last_idx]
+                        & range_mask (0, end - last_idx * ELEM_BITS));
+    }
+  return value ? ones : cnt - ones;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -250,16 +344,11 @@ bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
-  
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      return true;
-  return false;
+  return next_bit (b, start, start + cnt, value) < start + cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -298,13 +387,29 @@ bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
 
+  if (cnt == 0)
+    return start;
   if (cnt <= b->bit_cnt) 
     {
       size_t last = b->bit_cnt - cnt;
-      size_t i;
-      for (i = start; i <= last; i++)
-        if (!bitmap_contains (b, i, cnt, !value))
-          return i; 
+      size_t i = start;
+
+      /* Jump to the next bit set to VALUE, then to the first bit
+         after it that is not.  If that run is long enough, we are
+         done; otherwise no group can start before the end of the
+         run, so continue right after it. */
+      while (i <= last)
+        {
+          size_t end;
+
+          i = next_bit (b, i, b->bit_cnt, value);
+          if (i > last)
+            break;
+          end = next_bit (b, i, i + cnt, !value);
+          if (end == i + cnt)
+            return i;
+          i = end + 1;
+        }
     }
   return BITMAP_ERROR;
 }
@@ -358,6 +463,23 @@ bitmap_write (const struct bitmap *b, struct file *file)
   off_t size = byte_cnt (b->bit_cnt);
   return file_write_at (file, b->bits, size, 0) == size;
 }
+
+/* Writes the SIZE bytes at byte offset OFS of B's file
+   representation to the same offset in FILE, leaving the rest of
+   FILE alone.  Bytes past the end of B are not written.  Return
+   true if successful, false otherwise. */
+bool
+bitmap_write_part (const struct bitmap *b, struct file *file,
+                   size_t ofs, size_t size)
+{
+  size_t total = byte_cnt (b->bit_cnt);
+  if (ofs >= total)
+    return true;
+  if (size > total - ofs)
+    size = total - ofs;
+  return (size_t) file_write_at (file, (const uint8_t *) b->bits + ofs,
+                                 size, ofs) == size;
+}
 #endif /* FILESYS */
 
 /* Debugging. */
@@ -0,0 +1,200 @@
+/* Priority queue (pairing heap).
+
+   See heap.h for basic information.
+
+   The heap is a multiway tree kept in "leftmost child, right
+   sibling" form.  Every node compares no later than any of its
+   children, so the root is always the front of the heap.  Two
+   heaps are combined ("melded") by making the root that compares
+   later the leftmost child of the other root, which is all that
+   heap_push() needs to do.  Popping the root leaves a list of
+   subtrees that is melded back together in two passes: first
+   pairwise from left to right, then from right to left.  The
+   two-pass scheme is what gives pairing heaps their logarithmic
+   amortized bound. */
+
+#include "heap.h"
+#include "../debug.h"
+
+static struct heap_elem *meld (struct heap *,
+                               struct heap_elem *, struct heap_elem *);
+static struct heap_elem *merge_pairs (struct heap *, struct heap_elem *);
+static void detach (struct heap_elem *);
+
+/* Initializes H as an empty heap ordered by LESS, given
+   auxiliary data AUX. */
+void
+heap_init (struct heap *h, heap_less_func *less, void *aux)
+{
+  ASSERT (h != NULL);
+  ASSERT (less != NULL);
+
+  h->root = NULL;
+  h->elem_cnt = 0;
+  h->less = less;
+  h->aux = aux;
+}
+
+/* Inserts E into H. */
+void
+heap_push (struct heap *h, struct heap_elem *e)
+{
+  ASSERT (h != NULL);
+  ASSERT (e != NULL);
+
+  e->child = e->next = e->prev = NULL;
+  h->root = meld (h, h->root, e);
+  h->elem_cnt++;
+}
+
+/* Returns the front element of H without removing it.
+   Undefined behavior if H is empty. */
+struct heap_elem *
+heap_front (const struct heap *h)
+{
+  ASSERT (h->root != NULL);
+  return h->root;
+}
+
+/* Removes the front element from H and returns it.
+   Undefined behavior if H is empty. */
+struct heap_elem *
+heap_pop (struct heap *h)
+{
+  struct heap_elem *front = heap_front (h);
+
+  h->root = merge_pairs (h, front->child);
+  front->child = NULL;
+  h->elem_cnt--;
+  return front;
+}
+
+/* Removes E, which must be an element of H, from H. */
+void
+heap_remove (struct heap *h, struct heap_elem *e)
+{
+  struct heap_elem *subtree;
+
+  ASSERT (h != NULL);
+  ASSERT (e != NULL);
+  ASSERT (h->elem_cnt > 0);
+
+  if (e == h->root)
+    {
+      heap_pop (h);
+      return;
+    }
+
+  detach (e);
+  subtree = merge_pairs (h, e->child);
+  e->child = NULL;
+  h->root = meld (h, h->root, subtree);
+  h->elem_cnt--;
+}
+
+/* Restores the heap property after the value that E, an element
+   of H, is ordered by has changed. */
+void
+heap_update (struct heap *h, struct heap_elem *e)
+{
+  heap_remove (h, e);
+  heap_push (h, e);
+}
+
+/* Returns the number of elements in H. */
+size_t
+heap_size (const struct heap *h)
+{
+  return h->elem_cnt;
+}
+
+/* Returns true if H contains no elements, false otherwise. */
+bool
+heap_empty (const struct heap *h)
+{
+  return h->root == NULL;
+}
+
+/* Combines the trees rooted at A and B, either of which may be
+   null, and returns the root of the result.  On a tie A stays
+   at the root, so an element pushed later never overtakes an
+   equal element that is already the front. */
+static struct heap_elem *
+meld (struct heap *h, struct heap_elem *a, struct heap_elem *b)
+{
+  if (a == NULL)
+    return b;
+  if (b == NULL)
+    return a;
+
+  if (h->less (b, a, h->aux))
+    {
+      struct heap_elem *tmp = a;
+      a = b;
+      b = tmp;
+    }
+
+  /* Make B the leftmost child of A. */
+  b->prev = a;
+  b->next = a->child;
+  if (a->child != NULL)
+    a->child->prev = b;
+  a->child = b;
+
+  a->next = a->prev = NULL;
+  return a;
+}
+
+/* Melds the sibling list that starts at FIRST into a single tree
+   and returns its root, or a null pointer if FIRST is null. */
+static struct heap_elem *
+merge_pairs (struct heap *h, struct heap_elem *first)
+{
+  struct heap_elem *pairs = NULL;
+  struct heap_elem *root = NULL;
+
+  /* First pass: meld siblings pairwise from left to right,
+     collecting the results in reverse order through their
+     `next' members. */
+  while (first != NULL)
+    {
+      struct heap_elem *a = first;
+      struct heap_elem *b = a->next;
+
+      first = b != NULL ? b->next : NULL;
+      a->next = a->prev = NULL;
+      if (b != NULL)
+        b->next = b->prev = NULL;
+
+      a = meld (h, a, b);
+      a->next = pairs;
+      pairs = a;
+    }
+
+  /* Second pass: meld the pairs from right to left. */
+  while (pairs != NULL)
+    {
+      struct heap_elem *next = pairs->next;
+      pairs->next = NULL;
+      root = meld (h, root, pairs);
+      pairs = next;
+    }
+
+  return root;
+}
+
+/* Unlinks non-root element E, together with its subtree, from
+   its parent and siblings. */
+static void
+detach (struct heap_elem *e)
+{
+  ASSERT (e->prev != NULL);
+
+  if (e->prev->child == e)
+    e->prev->child = e->next;
+  else
+    e->prev->next = e->next;
+  if (e->next != NULL)
+    e->next->prev = e->prev;
+  e->next = e->prev = NULL;
+}
@@ -0,0 +1,81 @@
+#ifndef __LIB_KERNEL_HEAP_H
+#define __LIB_KERNEL_HEAP_H
+
+/* Priority queue (pairing heap).
+
+   Like lists and hash tables, this heap does not use dynamic
+   allocation.  Each structure that can potentially be in a heap
+   must embed a struct heap_elem member, and the heap_entry macro
+   converts a struct heap_elem back to the structure object that
+   contains it.  Refer to lib/kernel/list.h for a detailed
+   explanation of the technique.
+
+   The heap is ordered by a caller-supplied "less" function: the
+   front of the heap is an element E such that LESS (X, E) is
+   false for every other element X.  Elements that compare equal
+   leave the heap in an unspecified order, so callers that need
+   FIFO behavior among equals must break ties themselves.
+
+   Costs, for a heap of N elements:
+
+     - heap_push(), heap_front(), heap_empty(): O(1).
+
+     - heap_pop(), heap_remove(): O(log N) amortized.
+
+   No operation ever sleeps or allocates memory, so a heap may be
+   used from an interrupt handler as long as the caller provides
+   its own synchronization. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Heap element. */
+struct heap_elem
+  {
+    struct heap_elem *child;    /* Leftmost child. */
+    struct heap_elem *next;     /* Next sibling to the right. */
+    struct heap_elem *prev;     /* Left sibling, or parent if leftmost. */
+  };
+
+/* Converts pointer to heap element HEAP_ELEM into a pointer to
+   the structure that HEAP_ELEM is embedded inside.  Supply the
+   name of the outer structure STRUCT and the member name MEMBER
+   of the heap element. */
+#define heap_entry(HEAP_ELEM, STRUCT, MEMBER)           \
+        ((STRUCT *) ((uint8_t *) &(HEAP_ELEM)->child    \
+                     - offsetof (STRUCT, MEMBER.child)))
+
+/* Compares the value of two heap elements A and B, given
+   auxiliary data AUX.  Returns true if A must leave the heap
+   before B, false otherwise. */
+typedef bool heap_less_func (const struct heap_elem *a,
+                             const struct heap_elem *b,
+                             void *aux);
+
+/* Heap. */
+struct heap
+  {
+    struct heap_elem *root;     /* Front element, or null if empty. */
+    size_t elem_cnt;            /* Number of elements in heap. */
+    heap_less_func *less;       /* Comparison function. */
+    void *aux;                  /* Auxiliary data for `less'. */
+  };
+
+/* Basic life cycle. */
+void heap_init (struct heap *, heap_less_func *, void *aux);
+
+/* Insertion and removal. */
+void heap_push (struct heap *, struct heap_elem *);
+struct heap_elem *heap_pop (struct heap *);
+void heap_remove (struct heap *, struct heap_elem *);
+void heap_update (struct heap *, struct heap_elem *);
+
+/* Heap elements. */
+struct heap_elem *heap_front (const struct heap *);
+
+/* Information. */
+size_t heap_size (const struct heap *);
+bool heap_empty (const struct heap *);
+
+#endif /* lib/kernel/heap.h */
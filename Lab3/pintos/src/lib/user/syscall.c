@@ -182,3 +182,9 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+bool
+fsync (int fd) 
+{
+  return syscall1 (SYS_FSYNC, fd);
+}
@@ -44,5 +44,6 @@ bool mkdir (const char *dir);
 bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
+bool fsync (int fd);
 
 #endif /* lib/user/syscall.h */
@@ -0,0 +1,8 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my ($dir);
+$dir->{"f$_"} = [''] foreach grep ($_ % 2 || $_ < 100, 0...299);
+check_archive ({'many' => $dir});
+pass;
@@ -0,0 +1,89 @@
+/* Creates enough files in one directory for it to be indexed and
+   for the index to be rebuilt with more slots, then looks every
+   one of them up, removes half of them, and creates some again in
+   the entries that were freed.  Checks after each step that
+   exactly the files that should exist can be opened. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Number of files to create. */
+#define FILE_CNT 300
+
+/* Number of removed files to create again. */
+#define RECREATE_CNT 50
+
+/* Stores the name of file number I in NAME, which has room for
+   SIZE bytes. */
+static void
+file_name (char *name, size_t size, int i)
+{
+  snprintf (name, size, "many/f%d", i);
+}
+
+/* Checks that file number I can be opened if EXISTS is true, or
+   cannot be if it is false. */
+static void
+check_exists (int i, bool exists)
+{
+  char name[32];
+  int fd;
+
+  file_name (name, sizeof name, i);
+  fd = open (name);
+  if (exists)
+    {
+      CHECK (fd > 1, "open \"%s\"", name);
+      close (fd);
+    }
+  else
+    CHECK (fd == -1, "open \"%s\" (must return -1)", name);
+}
+
+void
+test_main (void) 
+{
+  char name[32];
+  int i;
+
+  CHECK (mkdir ("many"), "mkdir \"many\"");
+
+  msg ("creating %d files in \"many\"", FILE_CNT);
+  quiet = true;
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      file_name (name, sizeof name, i);
+      CHECK (create (name, 0), "create \"%s\"", name);
+    }
+  quiet = false;
+
+  msg ("opening each of them");
+  quiet = true;
+  for (i = 0; i <= FILE_CNT; i++)
+    check_exists (i, i < FILE_CNT);
+  quiet = false;
+
+  msg ("removing the even-numbered files");
+  quiet = true;
+  for (i = 0; i < FILE_CNT; i += 2)
+    {
+      file_name (name, sizeof name, i);
+      CHECK (remove (name), "remove \"%s\"", name);
+    }
+  for (i = 0; i < FILE_CNT; i++)
+    check_exists (i, i % 2);
+  quiet = false;
+
+  msg ("creating the first %d even-numbered files again", RECREATE_CNT);
+  quiet = true;
+  for (i = 0; i < RECREATE_CNT * 2; i += 2)
+    {
+      file_name (name, sizeof name, i);
+      CHECK (create (name, 0), "create \"%s\"", name);
+    }
+  for (i = 0; i < FILE_CNT; i++)
+    check_exists (i, i % 2 || i < RECREATE_CNT * 2);
+  quiet = false;
+}
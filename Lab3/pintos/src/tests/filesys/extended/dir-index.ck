@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-index) begin
+(dir-index) mkdir "many"
+(dir-index) creating 300 files in "many"
+(dir-index) opening each of them
+(dir-index) removing the even-numbered files
+(dir-index) creating the first 50 even-numbered files again
+(dir-index) end
+EOF
+pass;
@@ -0,0 +1,59 @@
+/* Writes a page into each of several files, at an offset far past
+   the size of the file system disk.  That only works if the parts
+   of the files skipped over take no space on disk.  Then checks
+   that the files read back, holes as zeros, and removes them. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 3
+#define FAR_OFS (7 * 1024 * 1024)
+
+static char buf[4096];
+static char zeros[sizeof buf];
+static char back[sizeof buf];
+
+void
+test_main (void) 
+{
+  char file_name[16];
+  int fd, i;
+
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (file_name, sizeof file_name, "file%d", i);
+      memset (buf, 'a' + i, sizeof buf);
+      CHECK (create (file_name, 0), "create \"%s\"", file_name);
+      CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+      seek (fd, FAR_OFS);
+      CHECK (write (fd, buf, sizeof buf) == (int) sizeof buf,
+             "write \"%s\" at offset %d", file_name, FAR_OFS);
+      if (filesize (fd) != FAR_OFS + (int) sizeof buf)
+        fail ("\"%s\" is %d bytes long, expected %d", file_name,
+              filesize (fd), FAR_OFS + (int) sizeof buf);
+      msg ("close \"%s\"", file_name);
+      close (fd);
+    }
+
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (file_name, sizeof file_name, "file%d", i);
+      memset (buf, 'a' + i, sizeof buf);
+      CHECK ((fd = open (file_name)) > 1, "open \"%s\" for verification",
+             file_name);
+      seek (fd, FAR_OFS / 2);
+      if (read (fd, back, sizeof back) != (int) sizeof back)
+        fail ("read of hole in \"%s\" failed", file_name);
+      compare_bytes (back, zeros, sizeof back, FAR_OFS / 2, file_name);
+      seek (fd, FAR_OFS);
+      if (read (fd, back, sizeof back) != (int) sizeof back)
+        fail ("read of data in \"%s\" failed", file_name);
+      compare_bytes (back, buf, sizeof back, FAR_OFS, file_name);
+      msg ("verified contents of \"%s\"", file_name);
+      close (fd);
+      CHECK (remove (file_name), "remove \"%s\"", file_name);
+    }
+}
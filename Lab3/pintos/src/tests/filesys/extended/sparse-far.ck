@@ -0,0 +1,30 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(sparse-far) begin
+(sparse-far) create "file0"
+(sparse-far) open "file0"
+(sparse-far) write "file0" at offset 7340032
+(sparse-far) close "file0"
+(sparse-far) create "file1"
+(sparse-far) open "file1"
+(sparse-far) write "file1" at offset 7340032
+(sparse-far) close "file1"
+(sparse-far) create "file2"
+(sparse-far) open "file2"
+(sparse-far) write "file2" at offset 7340032
+(sparse-far) close "file2"
+(sparse-far) open "file0" for verification
+(sparse-far) verified contents of "file0"
+(sparse-far) remove "file0"
+(sparse-far) open "file1" for verification
+(sparse-far) verified contents of "file1"
+(sparse-far) remove "file1"
+(sparse-far) open "file2" for verification
+(sparse-far) verified contents of "file2"
+(sparse-far) remove "file2"
+(sparse-far) end
+EOF
+pass;
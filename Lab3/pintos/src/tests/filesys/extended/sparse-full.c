@@ -0,0 +1,62 @@
+/* Fills up the file system disk with one file, then writes far
+   past the end of another, empty one, for which there is no room
+   left either.  A write that the full disk cuts short must leave
+   each file only as long as what was actually written to it. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FAR_OFS (1024 * 1024)
+
+/* More chunks than fit on the file system disk. */
+#define CHUNK_MAX 64
+
+static char buf[65536];
+
+void
+test_main (void) 
+{
+  int fill_fd, fd, ret, expected, chunks;
+  int total = 0;
+
+  CHECK (create ("filler", 0), "create \"filler\"");
+  CHECK (create ("sparse", 0), "create \"sparse\"");
+  CHECK ((fill_fd = open ("filler")) > 1, "open \"filler\"");
+  CHECK ((fd = open ("sparse")) > 1, "open \"sparse\"");
+  memset (buf, 'f', sizeof buf);
+
+  msg ("fill the disk with \"filler\"");
+  for (chunks = 0; ; chunks++)
+    {
+      if (chunks == CHUNK_MAX)
+        fail ("wrote %d bytes without filling the disk", total);
+      ret = write (fill_fd, buf, sizeof buf);
+      total += ret;
+      if (ret != (int) sizeof buf)
+        break;
+    }
+  if (filesize (fill_fd) != total)
+    fail ("\"filler\" is %d bytes long after %d bytes were written",
+          filesize (fill_fd), total);
+  msg ("\"filler\" is as long as what was written");
+
+  msg ("write far past the end of \"sparse\"");
+  seek (fd, FAR_OFS);
+  ret = write (fd, buf, sizeof buf);
+  if (ret == (int) sizeof buf)
+    fail ("write to a full disk succeeded");
+  expected = ret > 0 ? FAR_OFS + ret : 0;
+  if (filesize (fd) != expected)
+    fail ("\"sparse\" is %d bytes long after %d bytes were written "
+          "at offset %d", filesize (fd), ret, FAR_OFS);
+  msg ("\"sparse\" is as long as what was written");
+
+  msg ("close \"filler\"");
+  close (fill_fd);
+  msg ("close \"sparse\"");
+  close (fd);
+  CHECK (remove ("filler"), "remove \"filler\"");
+  CHECK (remove ("sparse"), "remove \"sparse\"");
+}
@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(sparse-full) begin
+(sparse-full) create "filler"
+(sparse-full) create "sparse"
+(sparse-full) open "filler"
+(sparse-full) open "sparse"
+(sparse-full) fill the disk with "filler"
+(sparse-full) "filler" is as long as what was written
+(sparse-full) write far past the end of "sparse"
+(sparse-full) "sparse" is as long as what was written
+(sparse-full) close "filler"
+(sparse-full) close "sparse"
+(sparse-full) remove "filler"
+(sparse-full) remove "sparse"
+(sparse-full) end
+EOF
+pass;
@@ -0,0 +1,7 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_archive ({"testfile" => ["\0" x 1000 . "a" x 100 . "\0" x 13900
+                               . "b" x 100 . "\0" x 4899 . "c"]});
+pass;
@@ -0,0 +1,39 @@
+/* Writes a few bytes here and there into an empty file, leaving
+   holes in between, and checks that the holes, as well as the
+   parts of the sectors around the written bytes that were not
+   written, read as zeros. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 20000
+static char buf[FILE_SIZE];
+
+/* Writes SIZE bytes of C at offset OFS of FILE_NAME, open as FD,
+   and records them in BUF. */
+static void
+write_at (const char *file_name, int fd, size_t ofs, char c, size_t size)
+{
+  memset (buf + ofs, c, size);
+  seek (fd, ofs);
+  CHECK (write (fd, buf + ofs, size) == (int) size,
+         "write %zu bytes at offset %zu in \"%s\"", size, ofs, file_name);
+}
+
+void
+test_main (void) 
+{
+  const char *file_name = "testfile";
+  int fd;
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  write_at (file_name, fd, 1000, 'a', 100);
+  write_at (file_name, fd, 15000, 'b', 100);
+  write_at (file_name, fd, FILE_SIZE - 1, 'c', 1);
+  msg ("close \"%s\"", file_name);
+  close (fd);
+  check_file (file_name, buf, sizeof buf);
+}
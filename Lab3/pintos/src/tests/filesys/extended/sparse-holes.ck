@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(sparse-holes) begin
+(sparse-holes) create "testfile"
+(sparse-holes) open "testfile"
+(sparse-holes) write 100 bytes at offset 1000 in "testfile"
+(sparse-holes) write 100 bytes at offset 15000 in "testfile"
+(sparse-holes) write 1 bytes at offset 19999 in "testfile"
+(sparse-holes) close "testfile"
+(sparse-holes) open "testfile" for verification
+(sparse-holes) verified contents of "testfile"
+(sparse-holes) close "testfile"
+(sparse-holes) end
+EOF
+pass;
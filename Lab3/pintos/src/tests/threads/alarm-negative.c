@@ -3,7 +3,7 @@
 #include <stdio.h>
 #include "tests/threads/tests.h"
 #include "threads/malloc.h"
-#include "threads/synch.h"
+#include "threads/semaphore.h"
 #include "threads/thread.h"
 #include "devices/timer.h"
 
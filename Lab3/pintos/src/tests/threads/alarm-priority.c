@@ -5,7 +5,7 @@
 #include "tests/threads/tests.h"
 #include "threads/init.h"
 #include "threads/malloc.h"
-#include "threads/synch.h"
+#include "threads/semaphore.h"
 #include "threads/thread.h"
 #include "devices/timer.h"
 
@@ -22,7 +22,7 @@ test_alarm_priority (void)
   ASSERT (!thread_mlfqs);
 
   wake_time = timer_ticks () + 5 * TIMER_FREQ;
-  sema_init (&wait_sema, 0);
+  semaphore_init (&wait_sema, 0);
   
   for (i = 0; i < 10; i++) 
     {
@@ -35,7 +35,7 @@ test_alarm_priority (void)
   thread_set_priority (PRI_MIN);
 
   for (i = 0; i < 10; i++)
-    sema_down (&wait_sema);
+    semaphore_down (&wait_sema);
 }
 
 static void
@@ -54,5 +54,5 @@ alarm_priority_thread (void *aux UNUSED)
   /* Print a message on wake-up. */
   msg ("Thread %s woke up.", thread_name ());
 
-  sema_up (&wait_sema);
+  semaphore_up (&wait_sema);
 }
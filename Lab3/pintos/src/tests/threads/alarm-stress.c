@@ -0,0 +1,127 @@
+/* Measures how much work the timer interrupt does per tick as
+   the number of threads blocked in timer_sleep() grows.
+
+   For each sleeper count, the sleepers are parked far enough in
+   the future that none of them wakes up during the measurement.
+   The main thread then counts how many iterations of an empty
+   loop it completes per tick.  Whatever the timer interrupt
+   does is time taken away from that loop, so the per-tick cost
+   of the sleep queue shows up as a drop against the baseline
+   measured with no sleepers at all.  With a sleep queue that
+   only looks at the earliest sleeper, all four numbers should
+   be about the same. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/barrier.h"
+#include "threads/init.h"
+#include "threads/malloc.h"
+#include "threads/semaphore.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* Number of ticks that each measurement runs for. */
+#define SAMPLE_TICKS (TIMER_FREQ / 2)
+
+/* Number of ticks allowed for the sleepers to fall asleep. */
+#define SETTLE_TICKS (TIMER_FREQ / 2)
+
+static thread_func sleeper_thread;
+static int64_t wake_time;
+static struct semaphore start_sema;
+static struct semaphore done_sema;
+
+static unsigned long long loops_per_tick (void);
+static void measure_sleepers (int count, unsigned long long baseline);
+
+void
+test_alarm_stress (void) 
+{
+  unsigned long long baseline;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  semaphore_init (&start_sema, 0);
+  semaphore_init (&done_sema, 0);
+
+  baseline = loops_per_tick ();
+  msg ("0 sleepers: %llu loops/tick", baseline);
+
+  measure_sleepers (10, baseline);
+  measure_sleepers (100, baseline);
+  measure_sleepers (1000, baseline);
+
+  pass ();
+}
+
+/* Puts COUNT threads to sleep, measures the loop rate with all
+   of them in the sleep queue, and waits for them to exit. */
+static void
+measure_sleepers (int count, unsigned long long baseline) 
+{
+  unsigned long long loops;
+  int created;
+  int i;
+
+  /* Sleepers run at a higher priority than we do, so each one
+     blocks on START_SEMA as soon as it is created, and goes to
+     sleep as soon as we release it. */
+  for (created = 0; created < count; created++) 
+    {
+      char name[32];
+      snprintf (name, sizeof name, "sleeper %d", created);
+      if (thread_create (name, PRI_DEFAULT + 1,
+                         sleeper_thread, NULL) == TID_ERROR)
+        break;
+    }
+  if (created < count)
+    msg ("only %d of %d sleepers could be created", created, count);
+
+  wake_time = timer_ticks () + SETTLE_TICKS + SAMPLE_TICKS + 1;
+  for (i = 0; i < created; i++)
+    semaphore_up (&start_sema);
+
+  loops = loops_per_tick ();
+  if (timer_ticks () >= wake_time)
+    fail ("sleepers woke up during the measurement");
+  msg ("%d sleepers: %llu loops/tick (%llu%% of baseline)",
+       created, loops, loops * 100 / baseline);
+
+  /* Wait for every sleeper to wake up and exit. */
+  timer_sleep (wake_time - timer_ticks ());
+  for (i = 0; i < created; i++)
+    semaphore_down (&done_sema);
+}
+
+/* Returns the number of iterations of an empty loop that the
+   running thread completes per timer tick. */
+static unsigned long long
+loops_per_tick (void) 
+{
+  unsigned long long loops = 0;
+  int64_t start_time;
+
+  /* Busy-wait until the current time changes, so that we start
+     counting at the very beginning of a timer tick. */
+  start_time = timer_ticks ();
+  while (timer_elapsed (start_time) == 0)
+    continue;
+
+  start_time = timer_ticks ();
+  while (timer_elapsed (start_time) < SAMPLE_TICKS) 
+    {
+      loops++;
+      barrier ();
+    }
+
+  return loops / SAMPLE_TICKS;
+}
+
+static void
+sleeper_thread (void *aux UNUSED) 
+{
+  semaphore_down (&start_sema);
+  timer_sleep (wake_time - timer_ticks ());
+  semaphore_up (&done_sema);
+}
@@ -0,0 +1,251 @@
+/* Checks the word-at-a-time bitmap_scan(), bitmap_count(),
+   bitmap_contains(), bitmap_set_multiple() and
+   bitmap_scan_and_flip() in lib/kernel/bitmap.c against
+   straightforward bit-at-a-time versions, on random maps of
+   every size up to MAX_BITS, then times both on maps of 1M
+   bits.  The timings are printed for reference only; the
+   checker looks only for the comparisons to pass. */
+
+#include <bitmap.h>
+#include <debug.h>
+#include <random.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "devices/timer.h"
+
+/* Size of the maps that are timed, in bits. */
+#define BENCH_BITS (1024 * 1024)
+
+/* Largest map that is checked for correctness, in bits. */
+#define MAX_BITS 300
+
+/* Number of queries per timed run. */
+#define BENCH_QUERIES 16
+
+static size_t ref_count (const struct bitmap *, size_t, size_t, bool);
+static bool ref_contains (const struct bitmap *, size_t, size_t, bool);
+static size_t ref_scan (const struct bitmap *, size_t, size_t, bool);
+static void ref_set_multiple (struct bitmap *, size_t, size_t, bool);
+static size_t ref_scan_and_flip (struct bitmap *, size_t, size_t, bool);
+static void fill_random (struct bitmap *, int density);
+static void verify (void);
+static void bench (const char *, struct bitmap *);
+
+void
+test_bitmap_words (void)
+{
+  struct bitmap *b;
+
+  msg ("Comparing maps of 1 to %d bits with bit-at-a-time versions.",
+       MAX_BITS);
+  verify ();
+  msg ("All comparisons matched.");
+
+  b = bitmap_create (BENCH_BITS);
+  if (b == NULL)
+    fail ("couldn't create %d-bit bitmap", BENCH_BITS);
+
+  /* Mostly allocated, like a busy free map: the only free run long
+     enough for the scans sits near the end. */
+  fill_random (b, 7);
+  bitmap_set_multiple (b, BENCH_BITS - 100, 64, false);
+  bench ("mostly set", b);
+
+  /* Every other bit set, so the scans find no two adjacent free
+     bits until the same run near the end. */
+  bitmap_set_all (b, false);
+  {
+    size_t i;
+    for (i = 0; i < BENCH_BITS; i += 2)
+      bitmap_mark (b, i);
+  }
+  bitmap_set_multiple (b, BENCH_BITS - 100, 64, false);
+  bench ("alternating", b);
+
+  bitmap_destroy (b);
+}
+
+/* Compares the real and reference versions on random maps of
+   every size up to MAX_BITS. */
+static void
+verify (void)
+{
+  size_t bit_cnt;
+
+  for (bit_cnt = 1; bit_cnt <= MAX_BITS; bit_cnt++)
+    {
+      struct bitmap *b = bitmap_create (bit_cnt);
+      struct bitmap *r = bitmap_create (bit_cnt);
+      int density;
+
+      if (b == NULL || r == NULL)
+        fail ("couldn't create %zu-bit bitmaps", bit_cnt);
+      for (density = 0; density <= 8; density += 2)
+        {
+          int q;
+
+          fill_random (b, density);
+          for (q = 0; q < 32; q++)
+            {
+              size_t start = random_ulong () % (bit_cnt + 1);
+              size_t cnt = random_ulong () % (bit_cnt - start + 1);
+              size_t scan_cnt = random_ulong () % 12;
+              bool value = random_ulong () % 2;
+              size_t i;
+
+              if (bitmap_count (b, start, cnt, value)
+                  != ref_count (b, start, cnt, value))
+                fail ("%zu bits: bitmap_count (%zu, %zu, %d) is wrong",
+                      bit_cnt, start, cnt, value);
+              if (bitmap_contains (b, start, cnt, value)
+                  != ref_contains (b, start, cnt, value))
+                fail ("%zu bits: bitmap_contains (%zu, %zu, %d) is wrong",
+                      bit_cnt, start, cnt, value);
+              if (bitmap_scan (b, start, scan_cnt, value)
+                  != ref_scan (b, start, scan_cnt, value))
+                fail ("%zu bits: bitmap_scan (%zu, %zu, %d) is wrong",
+                      bit_cnt, start, scan_cnt, value);
+
+              for (i = 0; i < bit_cnt; i++)
+                bitmap_set (r, i, bitmap_test (b, i));
+              bitmap_set_multiple (b, start, cnt, value);
+              ref_set_multiple (r, start, cnt, value);
+              if (bitmap_scan_and_flip (b, start, scan_cnt, value)
+                  != ref_scan_and_flip (r, start, scan_cnt, value))
+                fail ("%zu bits: bitmap_scan_and_flip (%zu, %zu, %d) "
+                      "is wrong", bit_cnt, start, scan_cnt, value);
+              for (i = 0; i < bit_cnt; i++)
+                if (bitmap_test (b, i) != bitmap_test (r, i))
+                  fail ("%zu bits: bit %zu differs after "
+                        "bitmap_set_multiple (%zu, %zu, %d)",
+                        bit_cnt, i, start, cnt, value);
+            }
+        }
+      bitmap_destroy (b);
+      bitmap_destroy (r);
+    }
+}
+
+/* Times BENCH_QUERIES rounds of each operation on B, first with
+   the real versions, then with the reference ones, and reports
+   the results in timer ticks.  B is left as it was. */
+static void
+bench (const char *name, struct bitmap *b)
+{
+  size_t expect_scan = bitmap_scan (b, 0, 64, false);
+  size_t expect_count = bitmap_count (b, 0, BENCH_BITS, true);
+  int64_t start, ticks;
+  int i;
+
+  start = timer_ticks ();
+  for (i = 0; i < BENCH_QUERIES; i++)
+    ASSERT (bitmap_scan (b, 0, 64, false) == expect_scan);
+  ticks = timer_elapsed (start);
+  start = timer_ticks ();
+  for (i = 0; i < BENCH_QUERIES; i++)
+    ASSERT (ref_scan (b, 0, 64, false) == expect_scan);
+  msg ("%s: scan (64): %lld ticks vs %lld bit-at-a-time.",
+       name, ticks, timer_elapsed (start));
+
+  start = timer_ticks ();
+  for (i = 0; i < BENCH_QUERIES; i++)
+    ASSERT (bitmap_count (b, 0, BENCH_BITS, true) == expect_count);
+  ticks = timer_elapsed (start);
+  start = timer_ticks ();
+  for (i = 0; i < BENCH_QUERIES; i++)
+    ASSERT (ref_count (b, 0, BENCH_BITS, true) == expect_count);
+  msg ("%s: count: %lld ticks vs %lld bit-at-a-time.",
+       name, ticks, timer_elapsed (start));
+
+  start = timer_ticks ();
+  for (i = 0; i < BENCH_QUERIES; i++)
+    ASSERT (bitmap_contains (b, 0, expect_scan, false)
+            == ref_contains (b, 0, expect_scan, false));
+  msg ("%s: contains: %lld ticks for both versions.",
+       name, timer_elapsed (start));
+
+  start = timer_ticks ();
+  for (i = 0; i < BENCH_QUERIES; i++)
+    {
+      size_t idx = bitmap_scan_and_flip (b, 0, 64, false);
+      ASSERT (idx == expect_scan);
+      bitmap_set_multiple (b, idx, 64, false);
+    }
+  ticks = timer_elapsed (start);
+  start = timer_ticks ();
+  for (i = 0; i < BENCH_QUERIES; i++)
+    {
+      size_t idx = ref_scan_and_flip (b, 0, 64, false);
+      ASSERT (idx == expect_scan);
+      ref_set_multiple (b, idx, 64, false);
+    }
+  msg ("%s: scan_and_flip: %lld ticks vs %lld bit-at-a-time.",
+       name, ticks, timer_elapsed (start));
+}
+
+/* Sets each bit of B with probability DENSITY / 8. */
+static void
+fill_random (struct bitmap *b, int density)
+{
+  size_t i;
+
+  for (i = 0; i < bitmap_size (b); i++)
+    bitmap_set (b, i, (int) (random_ulong () % 8) < density);
+}
+
+/* Reference versions: what lib/kernel/bitmap.c did before it
+   worked on whole elements at a time. */
+
+static size_t
+ref_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+  size_t i, value_cnt = 0;
+
+  for (i = 0; i < cnt; i++)
+    if (bitmap_test (b, start + i) == value)
+      value_cnt++;
+  return value_cnt;
+}
+
+static bool
+ref_contains (const struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    if (bitmap_test (b, start + i) == value)
+      return true;
+  return false;
+}
+
+static size_t
+ref_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+  if (cnt <= bitmap_size (b))
+    {
+      size_t last = bitmap_size (b) - cnt;
+      size_t i;
+      for (i = start; i <= last; i++)
+        if (!ref_contains (b, i, cnt, !value))
+          return i;
+    }
+  return BITMAP_ERROR;
+}
+
+static void
+ref_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    bitmap_set (b, start + i, value);
+}
+
+static size_t
+ref_scan_and_flip (struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+  size_t idx = ref_scan (b, start, cnt, value);
+  if (idx != BITMAP_ERROR)
+    ref_set_multiple (b, idx, cnt, !value);
+  return idx;
+}
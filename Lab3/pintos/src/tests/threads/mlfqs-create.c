@@ -0,0 +1,51 @@
+/* Checks that a thread can be created under the MLFQS, and that
+   it inherits its creator's nice value, which its priority
+   reflects.
+
+   The main thread sets its nice value to 5 and creates a thread,
+   which checks its own nice value and priority and then signals
+   the main thread. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/semaphore.h"
+#include "threads/thread.h"
+
+#define NICE 5
+
+static thread_func child_thread;
+
+void
+test_mlfqs_create (void) 
+{
+  struct semaphore done;
+
+  ASSERT (thread_mlfqs);
+
+  semaphore_init (&done, 0);
+  thread_set_nice (NICE);
+
+  msg ("Main thread creating child thread with nice %d.", NICE);
+  if (thread_create ("child", PRI_DEFAULT, child_thread, &done)
+      == TID_ERROR)
+    fail ("thread_create() failed");
+  semaphore_down (&done);
+  msg ("Child thread finished.");
+}
+
+static void
+child_thread (void *done_) 
+{
+  struct semaphore *done = done_;
+  int nice = thread_get_nice ();
+  int priority = thread_get_priority ();
+
+  if (nice != NICE)
+    fail ("child has nice %d, expected %d", nice, NICE);
+  if (priority < PRI_MIN || priority > PRI_MAX - 2 * NICE)
+    fail ("child has priority %d, expected at most %d",
+          priority, PRI_MAX - 2 * NICE);
+  msg ("Child thread inherited nice %d.", NICE);
+  semaphore_up (done);
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(mlfqs-create) begin
+(mlfqs-create) Main thread creating child thread with nice 5.
+(mlfqs-create) Child thread inherited nice 5.
+(mlfqs-create) Child thread finished.
+(mlfqs-create) end
+EOF
+pass;
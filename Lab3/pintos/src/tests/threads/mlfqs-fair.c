@@ -21,7 +21,7 @@
 #include "threads/init.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
-#include "threads/synch.h"
+#include "threads/lock.h"
 #include "threads/thread.h"
 #include "devices/timer.h"
 
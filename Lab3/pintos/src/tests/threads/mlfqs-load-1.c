@@ -10,7 +10,7 @@
 #include "tests/threads/tests.h"
 #include "threads/init.h"
 #include "threads/malloc.h"
-#include "threads/synch.h"
+#include "threads/lock.h"
 #include "threads/thread.h"
 #include "devices/timer.h"
 
@@ -1,17 +1,17 @@
-/* Tests that cond_signal() wakes up the highest-priority thread
-   waiting in cond_wait(). */
+/* Tests that condvar_signal() wakes up the highest-priority thread
+   waiting in condvar_wait(). */
 
 #include <stdio.h>
 #include "tests/threads/tests.h"
 #include "threads/init.h"
 #include "threads/malloc.h"
-#include "threads/synch.h"
+#include "threads/condvar.h"
 #include "threads/thread.h"
 #include "devices/timer.h"
 
 static thread_func priority_condvar_thread;
 static struct lock lock;
-static struct condition condition;
+static struct condvar condition;
 
 void
 test_priority_condvar (void) 
@@ -22,7 +22,7 @@ test_priority_condvar (void)
   ASSERT (!thread_mlfqs);
 
   lock_init (&lock);
-  cond_init (&condition);
+  condvar_init (&condition);
 
   thread_set_priority (PRI_MIN);
   for (i = 0; i < 10; i++) 
@@ -37,7 +37,7 @@ test_priority_condvar (void)
     {
       lock_acquire (&lock);
       msg ("Signaling...");
-      cond_signal (&condition, &lock);
+      condvar_signal (&condition, &lock);
       lock_release (&lock);
     }
 }
@@ -47,7 +47,7 @@ priority_condvar_thread (void *aux UNUSED)
 {
   msg ("Thread %s starting.", thread_name ());
   lock_acquire (&lock);
-  cond_wait (&condition, &lock);
+  condvar_wait (&condition, &lock);
   msg ("Thread %s woke up.", thread_name ());
   lock_release (&lock);
 }
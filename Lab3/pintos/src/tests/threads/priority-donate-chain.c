@@ -27,7 +27,7 @@
 #include <stdio.h>
 #include "tests/threads/tests.h"
 #include "threads/init.h"
-#include "threads/synch.h"
+#include "threads/lock.h"
 #include "threads/thread.h"
 
 #define NESTING_DEPTH 8
@@ -7,7 +7,7 @@
 #include <stdio.h>
 #include "tests/threads/tests.h"
 #include "threads/init.h"
-#include "threads/synch.h"
+#include "threads/lock.h"
 #include "threads/thread.h"
 
 static thread_func acquire_thread_func;
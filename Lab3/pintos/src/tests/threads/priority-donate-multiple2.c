@@ -17,7 +17,7 @@
 #include <stdio.h>
 #include "tests/threads/tests.h"
 #include "threads/init.h"
-#include "threads/synch.h"
+#include "threads/lock.h"
 #include "threads/thread.h"
 
 static thread_func a_thread_func;
@@ -12,7 +12,7 @@
 #include <stdio.h>
 #include "tests/threads/tests.h"
 #include "threads/init.h"
-#include "threads/synch.h"
+#include "threads/lock.h"
 #include "threads/thread.h"
 
 struct locks 
@@ -12,7 +12,7 @@
 #include "threads/init.h"
 #include "devices/timer.h"
 #include "threads/malloc.h"
-#include "threads/synch.h"
+#include "threads/lock.h"
 #include "threads/thread.h"
 
 struct simple_thread_data 
@@ -9,7 +9,7 @@
 #include <stdio.h>
 #include "tests/threads/tests.h"
 #include "threads/init.h"
-#include "threads/synch.h"
+#include "threads/semaphore.h"
 #include "threads/thread.h"
 
 static thread_func simple_thread_func;
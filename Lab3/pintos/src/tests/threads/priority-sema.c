@@ -5,7 +5,7 @@
 #include "tests/threads/tests.h"
 #include "threads/init.h"
 #include "threads/malloc.h"
-#include "threads/synch.h"
+#include "threads/semaphore.h"
 #include "threads/thread.h"
 #include "devices/timer.h"
 
@@ -20,7 +20,7 @@ test_priority_sema (void)
   /* This test does not work with the MLFQS. */
   ASSERT (!thread_mlfqs);
 
-  sema_init (&sema, 0);
+  semaphore_init (&sema, 0);
   thread_set_priority (PRI_MIN);
   for (i = 0; i < 10; i++) 
     {
@@ -32,7 +32,7 @@ test_priority_sema (void)
 
   for (i = 0; i < 10; i++) 
     {
-      sema_up (&sema);
+      semaphore_up (&sema);
       msg ("Back in main thread."); 
     }
 }
@@ -40,6 +40,6 @@ test_priority_sema (void)
 static void
 priority_sema_thread (void *aux UNUSED) 
 {
-  sema_down (&sema);
+  semaphore_down (&sema);
   msg ("Thread %s woke up.", thread_name ());
 }
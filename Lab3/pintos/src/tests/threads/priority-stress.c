@@ -0,0 +1,158 @@
+/* Measures scheduler latency, in CPU cycles, as the number of
+   ready threads grows.
+
+   A crowd of "filler" threads at low priority keeps yielding to
+   each other, so that whenever the main thread is running all of
+   them sit in the ready queues.  Two latencies are then sampled
+   with the time-stamp counter:
+
+     - switch: a round trip in which we wake a higher-priority
+       partner, which runs and blocks again before we resume.
+       That is one unblock, one block and two context switches.
+
+     - unblock: waking a thread that has the same priority as the
+       fillers, which must be queued behind all of them.
+
+   With O(1) ready queues neither number should depend on the
+   number of fillers. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/malloc.h"
+#include "threads/semaphore.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* Number of samples averaged for each latency. */
+#define SAMPLE_CNT 64
+
+/* Priority of fillers and of the unblocked waiter. */
+#define PRI_FILLER (PRI_MIN + 1)
+
+static thread_func filler_thread;
+static thread_func partner_thread;
+static thread_func waiter_thread;
+
+static volatile bool stop;
+static struct thread *waiter;
+static struct semaphore ping_sema;
+static struct semaphore wake_sema;
+static struct semaphore done_sema;
+
+static void measure_ready (int count);
+
+/* Returns the CPU's time-stamp counter. */
+static inline uint64_t
+rdtsc (void) 
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+void
+test_priority_stress (void) 
+{
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  semaphore_init (&ping_sema, 0);
+  semaphore_init (&wake_sema, 0);
+  semaphore_init (&done_sema, 0);
+
+  measure_ready (0);
+  measure_ready (10);
+  measure_ready (100);
+  measure_ready (1000);
+
+  pass ();
+}
+
+/* Fills the ready queues with COUNT threads, samples both
+   latencies, and waits for the helper threads to exit. */
+static void
+measure_ready (int count) 
+{
+  uint64_t switch_cycles = 0;
+  uint64_t unblock_cycles = 0;
+  int created;
+  int i;
+
+  stop = false;
+  waiter = NULL;
+  for (created = 0; created < count; created++) 
+    {
+      char name[32];
+      snprintf (name, sizeof name, "filler %d", created);
+      if (thread_create (name, PRI_FILLER,
+                         filler_thread, NULL) == TID_ERROR)
+        break;
+    }
+  if (created < count)
+    msg ("only %d of %d fillers could be created", created, count);
+
+  /* The partner runs right away and blocks on PING_SEMA. */
+  thread_create ("partner", PRI_DEFAULT + 1, partner_thread, NULL);
+  for (i = 0; i < SAMPLE_CNT; i++) 
+    {
+      uint64_t start = rdtsc ();
+      semaphore_up (&ping_sema);
+      switch_cycles += rdtsc () - start;
+    }
+
+  /* The waiter only runs when we sleep, since it has the same
+     priority as the fillers. */
+  thread_create ("waiter", PRI_FILLER, waiter_thread, NULL);
+  for (i = 0; i < SAMPLE_CNT; i++) 
+    {
+      uint64_t start;
+
+      while (waiter == NULL || waiter->status != THREAD_BLOCKED)
+        timer_sleep (1);
+
+      start = rdtsc ();
+      semaphore_up (&wake_sema);
+      unblock_cycles += rdtsc () - start;
+    }
+
+  msg ("%d ready threads: switch %llu cycles, unblock %llu cycles",
+       created, switch_cycles / SAMPLE_CNT, unblock_cycles / SAMPLE_CNT);
+
+  /* Release the helpers once both are blocked again, and wait
+     for all of them to exit. */
+  while (waiter->status != THREAD_BLOCKED)
+    timer_sleep (1);
+  stop = true;
+  semaphore_up (&ping_sema);
+  semaphore_up (&wake_sema);
+  for (i = 0; i < created + 2; i++)
+    semaphore_down (&done_sema);
+}
+
+static void
+filler_thread (void *aux UNUSED) 
+{
+  while (!stop)
+    thread_yield ();
+  semaphore_up (&done_sema);
+}
+
+static void
+partner_thread (void *aux UNUSED) 
+{
+  do
+    semaphore_down (&ping_sema);
+  while (!stop);
+  semaphore_up (&done_sema);
+}
+
+static void
+waiter_thread (void *aux UNUSED) 
+{
+  waiter = thread_current ();
+  do
+    semaphore_down (&wake_sema);
+  while (!stop);
+  semaphore_up (&done_sema);
+}
@@ -0,0 +1,129 @@
+/* Checks that a reader-writer lock lets readers share it, keeps
+   readers out while a writer holds it, and prefers a waiting
+   writer over newly arriving readers.
+
+   First, the main thread holds the lock for reading while a
+   writer and then a reader of higher priority ask for it.  The
+   writer must be let in before the reader.
+
+   Then READER_CNT readers and one writer, all of the same
+   priority, take the lock ITER_CNT times each, yielding while
+   they hold it so that the others get a chance to try. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/rwlock.h"
+#include "threads/semaphore.h"
+#include "threads/thread.h"
+
+#define READER_CNT 10
+#define ITER_CNT 20
+
+static struct rwlock rwlock;
+static struct semaphore done;
+
+static int active_readers;      /* Readers holding the lock. */
+static int max_readers;         /* Most readers seen at once. */
+static bool writing;            /* Writer holding the lock? */
+static bool overlap;            /* Reader and writer at once? */
+static int writes;              /* Writes completed. */
+
+static thread_func ordered_writer;
+static thread_func ordered_reader;
+static thread_func reader;
+static thread_func writer;
+
+void
+test_rwlock_readers (void) 
+{
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  rwlock_init (&rwlock);
+  semaphore_init (&done, 0);
+
+  rwlock_acquire_read (&rwlock);
+  thread_create ("writer", PRI_DEFAULT + 1, ordered_writer, NULL);
+  thread_create ("reader", PRI_DEFAULT + 1, ordered_reader, NULL);
+  msg ("Main thread releasing read lock.");
+  rwlock_release_read (&rwlock);
+  semaphore_down (&done);
+  semaphore_down (&done);
+
+  msg ("%d readers and 1 writer, %d iterations each.",
+       READER_CNT, ITER_CNT);
+  for (i = 0; i < READER_CNT; i++) 
+    {
+      char name[16];
+      snprintf (name, sizeof name, "reader %d", i);
+      thread_create (name, PRI_DEFAULT, reader, NULL);
+    }
+  thread_create ("writer", PRI_DEFAULT, writer, NULL);
+  for (i = 0; i < READER_CNT + 1; i++)
+    semaphore_down (&done);
+
+  msg ("Readers shared the lock: %s.", max_readers > 1 ? "yes" : "no");
+  msg ("Writer excluded readers: %s.", overlap ? "no" : "yes");
+  msg ("Writes completed: %d.", writes);
+}
+
+static void
+ordered_writer (void *aux UNUSED) 
+{
+  rwlock_acquire_write (&rwlock);
+  msg ("Writer got the lock.");
+  rwlock_release_write (&rwlock);
+  semaphore_up (&done);
+}
+
+static void
+ordered_reader (void *aux UNUSED) 
+{
+  rwlock_acquire_read (&rwlock);
+  msg ("Reader got the lock.");
+  rwlock_release_read (&rwlock);
+  semaphore_up (&done);
+}
+
+static void
+reader (void *aux UNUSED) 
+{
+  int i;
+
+  for (i = 0; i < ITER_CNT; i++) 
+    {
+      rwlock_acquire_read (&rwlock);
+      if (writing)
+        overlap = true;
+      if (++active_readers > max_readers)
+        max_readers = active_readers;
+      thread_yield ();
+      active_readers--;
+      rwlock_release_read (&rwlock);
+      thread_yield ();
+    }
+  semaphore_up (&done);
+}
+
+static void
+writer (void *aux UNUSED) 
+{
+  int i;
+
+  for (i = 0; i < ITER_CNT; i++) 
+    {
+      rwlock_acquire_write (&rwlock);
+      if (active_readers > 0)
+        overlap = true;
+      writing = true;
+      thread_yield ();
+      writing = false;
+      writes++;
+      rwlock_release_write (&rwlock);
+      thread_yield ();
+    }
+  semaphore_up (&done);
+}
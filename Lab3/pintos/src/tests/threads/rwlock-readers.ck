@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(rwlock-readers) begin
+(rwlock-readers) Main thread releasing read lock.
+(rwlock-readers) Writer got the lock.
+(rwlock-readers) Reader got the lock.
+(rwlock-readers) 10 readers and 1 writer, 20 iterations each.
+(rwlock-readers) Readers shared the lock: yes.
+(rwlock-readers) Writer excluded readers: yes.
+(rwlock-readers) Writes completed: 20.
+(rwlock-readers) end
+EOF
+pass;
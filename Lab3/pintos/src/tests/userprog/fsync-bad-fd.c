@@ -0,0 +1,18 @@
+/* Tries to fsync() fds that are not open, which must fail. */
+
+#include <limits.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  CHECK (!fsync (0), "fsync stdin");
+  CHECK (!fsync (1), "fsync stdout");
+  CHECK (!fsync (7), "fsync unopened fd");
+  CHECK (!fsync (2546), "fsync fd past the fd table");
+  CHECK (!fsync (-5), "fsync negative fd");
+  CHECK (!fsync (INT_MIN + 1), "fsync INT_MIN + 1");
+  CHECK (!fsync (INT_MAX - 1), "fsync INT_MAX - 1");
+}
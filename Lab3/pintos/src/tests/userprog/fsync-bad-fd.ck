@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(fsync-bad-fd) begin
+(fsync-bad-fd) fsync stdin
+(fsync-bad-fd) fsync stdout
+(fsync-bad-fd) fsync unopened fd
+(fsync-bad-fd) fsync fd past the fd table
+(fsync-bad-fd) fsync negative fd
+(fsync-bad-fd) fsync INT_MIN + 1
+(fsync-bad-fd) fsync INT_MAX - 1
+(fsync-bad-fd) end
+fsync-bad-fd: exit(0)
+EOF
+pass;
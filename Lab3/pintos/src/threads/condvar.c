@@ -37,6 +37,8 @@
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 
+static void condvar_wake(struct thread *);
+
 /* 
  * Initializes condition variable COND.  A condition variable
  * allows one piece of code to signal a condition and cooperating
@@ -46,7 +48,7 @@ void
 condvar_init(struct condvar *cond)
 {
     ASSERT(cond != NULL);
-    list_init(&cond->waiters);
+    thread_waiters_init(&cond->waiters);
 }
 
 /* 
@@ -79,11 +81,20 @@ condvar_wait(struct condvar *cond, struct lock *lock)
     ASSERT(!intr_context());
     ASSERT(lock_held_by_current_thread(lock));
 
-    struct semaphore waiter;
-    semaphore_init(&waiter, 0);
-    list_push_back(&cond->waiters, &waiter.elem);
+    /* 
+     * The running thread joins the waiters before giving up LOCK, so
+     * no signal can be missed.  Releasing LOCK may yield, and a
+     * signal may arrive before we block, in which case the signaller
+     * has already taken us off the waiters and we must not block. 
+     */
+    struct thread *cur = thread_current();
+    enum intr_level old_level = intr_disable();
+    thread_waiters_push(&cond->waiters);
     lock_release(lock);
-    semaphore_down(&waiter);
+    while (cur->wait_heap == &cond->waiters) {
+        thread_block();
+    }
+    intr_set_level(old_level);
     lock_acquire(lock);
 }
 
@@ -104,14 +115,17 @@ condvar_signal(struct condvar *cond, struct lock *lock UNUSED)
     ASSERT(!intr_context());
     ASSERT(lock_held_by_current_thread(lock));
 
-    if (!list_empty(&cond->waiters)) {
-        semaphore_up(list_entry(list_pop_front(&cond->waiters), struct semaphore, elem));
+    enum intr_level old_level = intr_disable();
+    if (!heap_empty(&cond->waiters)) {
+        condvar_wake(thread_waiters_pop(&cond->waiters));
     }
+    intr_set_level(old_level);
 }
 
 /* 
  * Wakes up all threads, if any, waiting on COND(protected by
- * LOCK).  LOCK must be held before calling this function.
+ * LOCK), highest priority first.  LOCK must be held before calling 
+ * this function.
  *
  * An interrupt handler cannot acquire a lock, so it does not
  * make sense to try to signal a condition variable within an
@@ -122,8 +136,28 @@ condvar_broadcast(struct condvar *cond, struct lock *lock)
 {
     ASSERT(cond != NULL);
     ASSERT(lock != NULL);
+    ASSERT(!intr_context());
+    ASSERT(lock_held_by_current_thread(lock));
+
+    enum intr_level old_level = intr_disable();
+    while (!heap_empty(&cond->waiters)) {
+        condvar_wake(thread_waiters_pop(&cond->waiters));
+    }
+    intr_set_level(old_level);
+}
+
+/* 
+ * Wakes T, which has just been taken off a condition variable's
+ * waiters.  T may not have blocked yet, if it was preempted while
+ * releasing its lock in condvar_wait(); it will then see that it
+ * has been signalled and not block at all. 
+ */
+static void
+condvar_wake(struct thread *t)
+{
+    ASSERT(intr_get_level() == INTR_OFF);
 
-    while (!list_empty(&cond->waiters)) {
-        condvar_signal(cond, lock);
+    if (t->status == THREAD_BLOCKED) {
+        thread_unblock(t);
     }
 }
@@ -6,7 +6,7 @@
 
 /* Condition variable */
 struct condvar {
-    struct list waiters; /* List of semaphore_elems */
+    struct heap waiters; /* Waiting threads, highest priority first */
 };
 
 void condvar_init(struct condvar *);
@@ -0,0 +1,65 @@
+#ifndef THREADS_FIXED_POINT_H
+#define THREADS_FIXED_POINT_H
+
+#include <stdint.h>
+
+/* Signed 17.14 fixed-point arithmetic, as used by the MLFQS
+   scheduler for load_avg and recent_cpu.
+
+   A fixed-point number X represents the real number X / 2**14,
+   so the 32 bits of an int hold a sign bit, 17 integer bits and
+   14 fraction bits.  Products and quotients of two fixed-point
+   numbers are computed in 64 bits so that the intermediate
+   result does not overflow. */
+
+typedef int fixed_t;
+
+/* Number of fraction bits. */
+#define FP_SHIFT 14
+
+/* Fixed-point representation of 1. */
+#define FP_ONE (1 << FP_SHIFT)
+
+/* Converts integer N to fixed point. */
+static inline fixed_t
+fp_from_int (int n)
+{
+  return n * FP_ONE;
+}
+
+/* Converts X to an integer, rounding toward zero. */
+static inline int
+fp_to_int (fixed_t x)
+{
+  return x / FP_ONE;
+}
+
+/* Converts X to an integer, rounding to nearest. */
+static inline int
+fp_round (fixed_t x)
+{
+  return x >= 0 ? (x + FP_ONE / 2) / FP_ONE : (x - FP_ONE / 2) / FP_ONE;
+}
+
+/* Returns X + N, where N is an integer. */
+static inline fixed_t
+fp_add_int (fixed_t x, int n)
+{
+  return x + n * FP_ONE;
+}
+
+/* Returns X * Y. */
+static inline fixed_t
+fp_mul (fixed_t x, fixed_t y)
+{
+  return ((int64_t) x) * y / FP_ONE;
+}
+
+/* Returns X / Y. */
+static inline fixed_t
+fp_div (fixed_t x, fixed_t y)
+{
+  return ((int64_t) x) * FP_ONE / y;
+}
+
+#endif /* threads/fixed-point.h */
@@ -39,7 +39,9 @@
 #include "devices/block.h"
 #include "devices/ide.h"
 #include "filesys/filesys.h"
+#include "filesys/fsbench.h"
 #include "filesys/fsutil.h"
+#include "filesys/inode.h"
 #endif
 
 /* Page directory with kernel mappings only. */
@@ -255,10 +257,21 @@ parse_options (char **argv)
 #ifdef FILESYS
       else if (!strcmp (name, "-f"))
         format_filesys = true;
+      else if (!strcmp (name, "-fsformat"))
+        {
+          if (value != NULL && !strcmp (value, "indexed"))
+            inode_set_format (INODE_FORMAT_INDEXED);
+          else if (value != NULL && !strcmp (value, "extent"))
+            inode_set_format (INODE_FORMAT_EXTENT);
+          else
+            PANIC ("unknown file system format `%s'", value);
+        }
       else if (!strcmp (name, "-filesys"))
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
         scratch_bdev_name = value;
+      else if (!strcmp (name, "-blktrace"))
+        block_trace_enable ();
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
@@ -327,6 +340,8 @@ run_actions (char **argv)
       {"rm", 2, fsutil_rm},
       {"extract", 1, fsutil_extract},
       {"append", 2, fsutil_append},
+      {"bench-ide", 1, fsbench_ide},
+      {"bench-channels", 1, fsbench_channels},
 #endif
       {NULL, 0, NULL},
     };
@@ -376,6 +391,9 @@ usage (void)
           "Use these actions indirectly via `pintos' -g and -p options:\n"
           "  extract            Untar from scratch device into file system.\n"
           "  append FILE        Append FILE to tar file on scratch device.\n"
+          "Benchmarks, which print their timings:\n"
+          "  bench-ide          Read the file system device by PIO and by DMA.\n"
+          "  bench-channels     Write swap and read a file, apart and at once.\n"
 #endif
           "\nOptions:\n"
           "  -h                 Print this help message and power off.\n"
@@ -383,8 +401,10 @@ usage (void)
           "  -r                 Reboot after actions.\n"
 #ifdef FILESYS
           "  -f                 Format file system device during startup.\n"
+          "  -fsformat=FORMAT   Format with `extent' (default) or `indexed' inodes.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+          "  -blktrace          Print the last block requests at power off.\n"
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
 #endif
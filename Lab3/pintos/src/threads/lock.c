@@ -36,6 +36,28 @@
 #include "threads/lock.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "devices/timer.h"
+
+/* 
+ * Maximum length of a donation chain, that is, the number of
+ * lock holders that a single lock_acquire() will pass its
+ * priority along to.  Bounds the time spent with interrupts
+ * disabled when locks are nested deeply.
+ */
+#define DONATION_DEPTH_MAX 8
+
+/* 
+ * Maximum number of times an adaptive lock yields to its holder
+ * before the waiter gives up and blocks.
+ */
+#define SPIN_MAX 4
+
+/* Adaptive locks, whose counters lock_print_stats() reports. */
+static struct list named_locks = LIST_INITIALIZER(named_locks);
+
+static bool lock_spin(struct lock *);
+static void lock_donate(struct lock *, int priority);
+static void lock_take(struct lock *);
 
 /* 
  * Initializes LOCK.  A lock can be held by at most a single
@@ -60,14 +82,48 @@ lock_init(struct lock *lock)
     ASSERT(lock != NULL);
 
     lock->holder = NULL;
+    lock->max_priority = PRI_MIN;
+    lock->adaptive = false;
+    lock->name = NULL;
+    lock->acquire_cnt = 0;
+    lock->contend_cnt = 0;
+    lock->wait_ticks = 0;
     semaphore_init(&lock->semaphore, 1);
 }
 
+/* 
+ * Initializes LOCK as an adaptive lock named NAME.  A thread that
+ * finds an adaptive lock held first gives the holder a chance to
+ * finish its critical section, if the holder is runnable, and only
+ * blocks if the lock is still held after that.  This saves the
+ * block/unblock round trip for short critical sections.
+ *
+ * LOCK's contention counters are reported by lock_print_stats(),
+ * so LOCK must never be freed. 
+ */
+void
+lock_init_adaptive(struct lock *lock, const char *name)
+{
+    ASSERT(name != NULL);
+
+    lock_init(lock);
+    lock->adaptive = true;
+    lock->name = name;
+
+    enum intr_level old_level = intr_disable();
+    list_push_back(&named_locks, &lock->statelem);
+    intr_set_level(old_level);
+}
+
 /* 
  * Acquires LOCK, sleeping until it becomes available if
  * necessary.  The lock must not already be held by the current
  * thread.
  *
+ * If LOCK is held by a lower-priority thread, the current
+ * thread's priority is donated to the holder, and on along the
+ * chain of locks that the holder is itself waiting for.
+ *
  * This function may sleep, so it must not be called within an
  * interrupt handler.  This function may be called with
  * interrupts disabled, but interrupts will be turned back on if
@@ -80,8 +136,34 @@ lock_acquire(struct lock *lock)
     ASSERT(!intr_context());
     ASSERT(!lock_held_by_current_thread(lock));
 
-    semaphore_down(&lock->semaphore);
-    lock->holder = thread_current();
+    struct thread *cur = thread_current();
+    enum intr_level old_level = intr_disable();
+    if (lock->holder == NULL) {
+        semaphore_down(&lock->semaphore);
+        lock_take(lock);
+    } else {
+        int64_t start = timer_ticks();
+
+        lock->contend_cnt++;
+        if (!lock->adaptive || !lock_spin(lock)) {
+            /* A waiter woken by lock_release() can still lose the
+               lock to a thread taking the fast path above before
+               it runs, so donate again to whoever holds the lock
+               now each time we go back to sleep. */
+            while (!semaphore_try_down(&lock->semaphore)) {
+                if (!thread_mlfqs) {
+                    cur->waiting_lock = lock;
+                    lock_donate(lock, cur->priority);
+                }
+                thread_waiters_push(&lock->semaphore.waiters);
+                thread_block();
+            }
+            cur->waiting_lock = NULL;
+            lock_take(lock);
+        }
+        lock->wait_ticks += timer_ticks() - start;
+    }
+    intr_set_level(old_level);
 }
 
 /* 
@@ -98,15 +180,19 @@ lock_try_acquire(struct lock *lock)
     ASSERT(lock != NULL);
     ASSERT(!lock_held_by_current_thread(lock));
 
+    enum intr_level old_level = intr_disable();
     bool success = semaphore_try_down(&lock->semaphore);
     if (success) {
-        lock->holder = thread_current();
+        lock_take(lock);
     }
+    intr_set_level(old_level);
     return success;
 }
 
 /* 
  * Releases LOCK, which must be owned by the current thread.
+ * Any priority donated through LOCK is given up, and the current
+ * thread yields if it no longer has the highest priority.
  *
  * An interrupt handler cannot acquire a lock, so it does not
  * make sense to try to release a lock within an interrupt
@@ -118,8 +204,16 @@ lock_release(struct lock *lock)
     ASSERT(lock != NULL);
     ASSERT(lock_held_by_current_thread(lock));
 
+    struct thread *cur = thread_current();
+    enum intr_level old_level = intr_disable();
+    list_remove(&lock->elem);
     lock->holder = NULL;
+    if (!thread_mlfqs) {
+        thread_priority_refresh(cur);
+    }
     semaphore_up(&lock->semaphore);
+    thread_yield_to_higher_priority();
+    intr_set_level(old_level);
 }
 
 /* 
@@ -132,3 +226,119 @@ lock_held_by_current_thread(const struct lock *lock)
     ASSERT(lock != NULL);
     return lock->holder == thread_current();
 }
+
+/* 
+ * Prints the contention counters of every adaptive lock. 
+ */
+void
+lock_print_stats(void)
+{
+    struct list_elem *e;
+
+    for (e = list_begin(&named_locks); e != list_end(&named_locks);
+         e = list_next(e)) {
+        struct lock *lock = list_entry(e, struct lock, statelem);
+        printf("Lock %s: %u acquisitions, %u contended, %lld wait ticks\n",
+               lock->name, lock->acquire_cnt, lock->contend_cnt,
+               lock->wait_ticks);
+    }
+}
+
+/* 
+ * Tries to take adaptive LOCK without blocking, by yielding to
+ * its holder while the holder is runnable, up to SPIN_MAX times.
+ * Returns true if LOCK was acquired.
+ *
+ * On a uniprocessor the holder cannot be running while we are, so
+ * "spinning" means yielding.  That only helps if the scheduler
+ * will then actually run the holder, that is, if the holder is
+ * ready and has at least our priority.  A blocked holder, or one
+ * we would preempt straight away, is not worth waiting for.
+ *
+ * Must be called with interrupts disabled. 
+ */
+static bool
+lock_spin(struct lock *lock)
+{
+    struct thread *cur = thread_current();
+    int spin;
+
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    for (spin = 0; spin < SPIN_MAX; spin++) {
+        struct thread *holder = lock->holder;
+
+        if (holder == NULL && semaphore_try_down(&lock->semaphore)) {
+            lock_take(lock);
+            return true;
+        }
+        if (holder != NULL
+            && (holder->status != THREAD_READY
+                || holder->priority < cur->priority)) {
+            break;
+        }
+        thread_yield();
+    }
+    return false;
+}
+
+/* 
+ * Records that a thread of the given PRIORITY is waiting for
+ * LOCK, and raises the priority of LOCK's holder to match.  If
+ * the holder is itself waiting for a lock, the donation is
+ * passed along, up to DONATION_DEPTH_MAX holders deep.  Stops
+ * early as soon as a holder already runs at PRIORITY or above,
+ * since everything further along the chain must too.
+ *
+ * Must be called with interrupts disabled. 
+ */
+static void
+lock_donate(struct lock *lock, int priority)
+{
+    int depth;
+
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    for (depth = 0; lock != NULL && depth < DONATION_DEPTH_MAX; depth++) {
+        struct thread *holder = lock->holder;
+
+        if (lock->max_priority < priority) {
+            lock->max_priority = priority;
+        }
+        if (holder == NULL || holder->priority >= priority) {
+            break;
+        }
+        thread_priority_donate(holder, priority);
+        lock = holder->waiting_lock;
+    }
+}
+
+/* 
+ * Makes the current thread the holder of LOCK, which it has just
+ * acquired.  Threads still waiting for LOCK now donate to the
+ * new holder, so the lock's donated priority becomes that of the
+ * highest-priority waiter.
+ *
+ * Must be called with interrupts disabled. 
+ */
+static void
+lock_take(struct lock *lock)
+{
+    struct thread *cur = thread_current();
+    struct heap *waiters = &lock->semaphore.waiters;
+
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    lock->holder = cur;
+    lock->acquire_cnt++;
+    list_push_back(&cur->locks, &lock->elem);
+
+    lock->max_priority = PRI_MIN;
+    if (!heap_empty(waiters)) {
+        lock->max_priority = 
+            heap_entry(heap_front(waiters), struct thread, waitelem)->priority;
+    }
+    if (!thread_mlfqs) {
+        thread_priority_donate(cur, lock->max_priority);
+    }
+}
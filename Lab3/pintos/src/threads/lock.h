@@ -1,18 +1,31 @@
 #ifndef LOCK_H
 #define LOCK_H
 
+#include <list.h>
+#include <stdint.h>
 #include "threads/semaphore.h"
 
 /* Lock */
 struct lock {
     struct thread *holder; /* Thread holding lock (for debugging) */
     struct semaphore semaphore; /* Binary semaphore controlling access */
+    struct list_elem elem; /* Element in holder's list of held locks */
+    int max_priority; /* Highest priority donated by a waiting thread */
+
+    bool adaptive; /* Yield to a runnable holder before blocking? */
+    const char *name; /* Name for lock_print_stats(), or NULL */
+    struct list_elem statelem; /* Element in list of named locks */
+    unsigned acquire_cnt; /* Number of acquisitions */
+    unsigned contend_cnt; /* Acquisitions that found the lock held */
+    int64_t wait_ticks; /* Timer ticks spent waiting for the lock */
 };
 
 void lock_init(struct lock *);
+void lock_init_adaptive(struct lock *, const char *name);
 void lock_acquire(struct lock *);
 bool lock_try_acquire(struct lock *);
 void lock_release(struct lock *);
 bool lock_held_by_current_thread(const struct lock *);
+void lock_print_stats(void);
 
 #endif /* UCSC CMPS111 */
@@ -0,0 +1,164 @@
+#include <stdio.h>
+
+#include "threads/rwlock.h"
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+
+static int waiter_priority(const struct condvar *);
+static void rwlock_wake(struct rwlock *);
+
+/* 
+ * Initializes RWLOCK.  A reader-writer lock can be held by any
+ * number of readers at once, or by a single writer.
+ *
+ * Writers are preferred: a thread that asks to read waits while
+ * any writer of at least its own priority is waiting, so a steady
+ * stream of readers cannot starve a writer.  A reader of higher
+ * priority than every waiting writer is let in ahead of them.  When
+ * the lock becomes free it goes to the highest-priority waiting
+ * writer, unless some waiting reader has a higher priority still,
+ * in which case all waiting readers are let in together.
+ *
+ * Unlike struct lock, a reader-writer lock does not donate
+ * priority to the threads holding it. 
+ */
+void
+rwlock_init(struct rwlock *rw)
+{
+    ASSERT(rw != NULL);
+
+    lock_init(&rw->lock);
+    condvar_init(&rw->readers_ok);
+    condvar_init(&rw->writers_ok);
+    rw->readers = 0;
+    rw->waiting_writers = 0;
+    rw->writer = NULL;
+}
+
+/* 
+ * Acquires RWLOCK for reading, sleeping until no writer holds it
+ * and no writer of equal or higher priority is waiting for it.
+ *
+ * This function may sleep, so it must not be called within an
+ * interrupt handler. 
+ */
+void
+rwlock_acquire_read(struct rwlock *rw)
+{
+    ASSERT(rw != NULL);
+    ASSERT(!intr_context());
+    ASSERT(rw->writer != thread_current());
+
+    int priority = thread_get_priority();
+
+    lock_acquire(&rw->lock);
+    while (rw->writer != NULL
+           || (rw->waiting_writers > 0
+               && waiter_priority(&rw->writers_ok) >= priority)) {
+        condvar_wait(&rw->readers_ok, &rw->lock);
+    }
+    rw->readers++;
+    lock_release(&rw->lock);
+}
+
+/* 
+ * Releases RWLOCK, which the current thread must hold for
+ * reading. 
+ */
+void
+rwlock_release_read(struct rwlock *rw)
+{
+    ASSERT(rw != NULL);
+
+    lock_acquire(&rw->lock);
+    ASSERT(rw->readers > 0);
+    if (--rw->readers == 0) {
+        rwlock_wake(rw);
+    }
+    lock_release(&rw->lock);
+}
+
+/* 
+ * Acquires RWLOCK for writing, sleeping until no other thread
+ * holds it.
+ *
+ * This function may sleep, so it must not be called within an
+ * interrupt handler. 
+ */
+void
+rwlock_acquire_write(struct rwlock *rw)
+{
+    ASSERT(rw != NULL);
+    ASSERT(!intr_context());
+    ASSERT(rw->writer != thread_current());
+
+    lock_acquire(&rw->lock);
+    rw->waiting_writers++;
+    while (rw->writer != NULL || rw->readers > 0) {
+        condvar_wait(&rw->writers_ok, &rw->lock);
+    }
+    rw->waiting_writers--;
+    rw->writer = thread_current();
+    lock_release(&rw->lock);
+}
+
+/* 
+ * Releases RWLOCK, which the current thread must hold for
+ * writing. 
+ */
+void
+rwlock_release_write(struct rwlock *rw)
+{
+    ASSERT(rw != NULL);
+    ASSERT(rwlock_write_held_by_current_thread(rw));
+
+    lock_acquire(&rw->lock);
+    rw->writer = NULL;
+    rwlock_wake(rw);
+    lock_release(&rw->lock);
+}
+
+/* 
+ * Returns true if the current thread holds RWLOCK for writing,
+ * false otherwise. 
+ */
+bool
+rwlock_write_held_by_current_thread(const struct rwlock *rw)
+{
+    ASSERT(rw != NULL);
+
+    return rw->writer == thread_current();
+}
+
+/* 
+ * Returns the priority of the highest-priority thread waiting on
+ * COND, or PRI_MIN - 1 if there is none. 
+ */
+static int
+waiter_priority(const struct condvar *cond)
+{
+    if (heap_empty(&cond->waiters)) {
+        return PRI_MIN - 1;
+    }
+    return heap_entry(heap_front(&cond->waiters), struct thread, 
+                      waitelem)->priority;
+}
+
+/* 
+ * Hands RWLOCK, which has just become free, to the waiting writer
+ * or readers that should have it next.  Must be called with the
+ * lock's internal lock held. 
+ */
+static void
+rwlock_wake(struct rwlock *rw)
+{
+    ASSERT(lock_held_by_current_thread(&rw->lock));
+
+    if (!heap_empty(&rw->writers_ok.waiters)
+        && waiter_priority(&rw->writers_ok) 
+           >= waiter_priority(&rw->readers_ok)) {
+        condvar_signal(&rw->writers_ok, &rw->lock);
+    } else {
+        condvar_broadcast(&rw->readers_ok, &rw->lock);
+    }
+}
@@ -0,0 +1,25 @@
+#ifndef RWLOCK_H
+#define RWLOCK_H
+
+#include <stdbool.h>
+#include "threads/condvar.h"
+#include "threads/lock.h"
+
+/* Reader-writer lock */
+struct rwlock {
+    struct lock lock; /* Protects the members below */
+    struct condvar readers_ok; /* Signalled when readers may enter */
+    struct condvar writers_ok; /* Signalled when a writer may enter */
+    int readers; /* Number of threads holding the lock for reading */
+    int waiting_writers; /* Number of threads waiting to write */
+    struct thread *writer; /* Thread holding the lock for writing */
+};
+
+void rwlock_init(struct rwlock *);
+void rwlock_acquire_read(struct rwlock *);
+void rwlock_release_read(struct rwlock *);
+void rwlock_acquire_write(struct rwlock *);
+void rwlock_release_write(struct rwlock *);
+bool rwlock_write_held_by_current_thread(const struct rwlock *);
+
+#endif /* UCSC CMPS111 */
@@ -53,7 +53,7 @@ semaphore_init(struct semaphore *sema, unsigned value)
     ASSERT(sema != NULL);
 
     sema->value = value;
-    list_init(&sema->waiters);
+    thread_waiters_init(&sema->waiters);
 }
 
 /* 
@@ -73,7 +73,7 @@ semaphore_down(struct semaphore *sema)
 
     enum intr_level old_level = intr_disable();
     while (sema->value == 0) {
-        list_push_back(&sema->waiters, &thread_current()->elem);
+        thread_waiters_push(&sema->waiters);
         thread_block();
     }
     sema->value--;
@@ -107,7 +107,11 @@ semaphore_try_down(struct semaphore *semaphore)
 
 /* 
  * Up or Dijkstra's "V" operation on a semaphore.  Increments SEMA's value
- * and wakes up one thread of those waiting for SEMA, if any.
+ * and wakes up the highest-priority thread of those waiting for SEMA, 
+ * if any.
+ *
+ * The value is incremented before the waiter is unblocked, since
+ * unblocking a higher-priority thread switches to it straight away.
  *
  * This function may be called from an interrupt handler. 
  */
@@ -119,10 +123,9 @@ semaphore_up(struct semaphore *semaphore)
     ASSERT(semaphore != NULL);
 
     old_level = intr_disable();
-    if (!list_empty(&semaphore->waiters)) {
-        thread_unblock(list_entry(
-            list_pop_front(&semaphore->waiters), struct thread, elem));
-    }
     semaphore->value++;
+    if (!heap_empty(&semaphore->waiters)) {
+        thread_unblock(thread_waiters_pop(&semaphore->waiters));
+    }
     intr_set_level(old_level);
 }
@@ -1,14 +1,13 @@
 #ifndef SEMAPHORE_H
 #define SEMAPHORE_H
 
-#include <list.h>
+#include <heap.h>
 #include <stdbool.h>
 
 /* Semaphore */
 struct semaphore {
     unsigned value; /* Current value */
-    struct list waiters; /* List of waiting threads */
-    struct list_elem elem; /* condvar waiters list elem  */
+    struct heap waiters; /* Waiting threads, highest priority first */
 };
 
 void semaphore_init(struct semaphore *, unsigned value);
@@ -44,6 +44,7 @@
 #include "threads/lock.h"
 #include "threads/semaphore.h"
 #include "threads/vaddr.h"
+#include "devices/timer.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #endif
@@ -53,12 +54,19 @@
 // of thread.h for details. 
 #define THREAD_MAGIC 0xcd6abf4b
 
-// List of processes in THREAD_READY state, that is, processes
-// that are ready to run but not actually running. 
-static struct list ready_list;
+// Processes in THREAD_READY state, that is, processes that are
+// ready to run but not actually running.  There is one FIFO run
+// queue per priority, and bit P of ready_mask is set exactly when
+// ready_queues[P] is nonempty, so the highest ready priority is
+// found with a bit scan instead of a list walk.
+static struct list ready_queues[PRI_MAX + 1];
+static uint64_t ready_mask;
+static int ready_cnt;           // # of threads in all ready_queues.
 
-// List of processes in sleep (wait) state (i.e. wait queue).
-static struct list wait_list;
+// Processes in sleep (wait) state (i.e. wait queue), as a
+// min-heap keyed on sleep_endtick so that a timer tick only has
+// to look at the earliest sleeper.
+static struct heap sleep_heap;
 
 // List of all processes.  Processes are added to this list
 // when they are first scheduled and removed when they exit.
@@ -95,6 +103,14 @@ static unsigned thread_ticks;   /* # of timer ticks since last yield. */
 // Controlled by kernel command-line option "-o mlfqs". 
 bool thread_mlfqs;
 
+// System load average, for the MLFQS: an exponentially weighted
+// moving average of the number of threads ready to run.
+static fixed_t load_avg;
+
+// Arrival counter for semaphore and condvar waiters, so that
+// waiters of equal priority are woken first-come first-served.
+static uint64_t next_wait_seq;
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
@@ -107,8 +123,18 @@ static void schedule (void);
 void thread_schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
 
-static bool comparator_greater_thread_priority
-  (const struct list_elem *, const struct list_elem *, void *aux);
+static void ready_queue_push (struct thread *);
+static void ready_queue_remove (struct thread *);
+static int ready_queue_max_priority (void);
+static void change_priority (struct thread *, int priority);
+
+static void mlfqs_tick (struct thread *, int64_t tick);
+static void mlfqs_update_priority (struct thread *);
+static void mlfqs_update_recent_cpu (struct thread *, void *aux);
+static bool comparator_less_sleep_endtick
+  (const struct heap_elem *, const struct heap_elem *, void *aux);
+static bool comparator_less_waiter
+  (const struct heap_elem *, const struct heap_elem *, void *aux);
 
 
 // Initializes the threading system by transforming the code
@@ -127,11 +153,17 @@ static bool comparator_greater_thread_priority
 void
 thread_init (void)
 {
+  int i;
+
   ASSERT (intr_get_level () == INTR_OFF);
 
   lock_init (&tid_lock);
-  list_init (&ready_list);
-  list_init (&wait_list);
+  for (i = PRI_MIN; i <= PRI_MAX; i++)
+    list_init (&ready_queues[i]);
+  ready_mask = 0;
+  ready_cnt = 0;
+  load_avg = 0;
+  heap_init (&sleep_heap, comparator_less_sleep_endtick, NULL);
   list_init (&all_list);
 
   /* Set up a thread structure for the running thread. */
@@ -161,22 +193,24 @@ thread_start (void)
 
 // Wake up all sleeping threads whose ticks_end has been expired,
 // removing from the wait queue and pushing it into the ready queue.
+// Sleepers leave the heap in wakeup order, so the scan stops at
+// the first one that is still due in the future.
 //
 // Must be called with interrupts turned off. 
 static void
 wake_sleeping_threads (int64_t current_tick) {
-  struct list_elem *e;
-
   ASSERT (intr_get_level () == INTR_OFF);
 
-  for (e = list_begin (&wait_list); e != list_end (&wait_list); e = list_next (e))
+  while (!heap_empty (&sleep_heap))
     {
-      struct thread *t = list_entry (e, struct thread, waitelem);
-      if (t->sleep_endtick <= current_tick) {
-        t->sleep_endtick = 0;
-        list_remove (&t->waitelem);
-        thread_unblock(t);
-      }
+      struct thread *t = heap_entry (heap_front (&sleep_heap),
+                                     struct thread, sleepelem);
+      if (t->sleep_endtick > current_tick)
+        break;
+
+      heap_pop (&sleep_heap);
+      t->sleep_endtick = 0;
+      thread_unblock(t);
     }
 }
 
@@ -200,16 +234,89 @@ thread_tick (int64_t tick)
 
   wake_sleeping_threads(tick);
 
+  if (thread_mlfqs)
+    mlfqs_tick (t, tick);
+
   if (++thread_ticks >= TIME_SLICE)
     intr_yield_on_return ();
 }
 
+// Does the MLFQS bookkeeping for timer tick TICK, during which
+// thread T was running.
+//
+// Only T's recent_cpu and priority change on an ordinary tick;
+// the load average and every other thread are updated once per
+// second.
+static void
+mlfqs_tick (struct thread *t, int64_t tick)
+{
+  bool recompute_all = tick % TIMER_FREQ == 0;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (t != idle_thread)
+    t->recent_cpu = fp_add_int (t->recent_cpu, 1);
+
+  if (recompute_all)
+    {
+      int ready_threads = ready_cnt + (t != idle_thread ? 1 : 0);
+      load_avg = fp_mul (fp_div (fp_from_int (59), fp_from_int (60)), load_avg)
+                 + fp_from_int (ready_threads) / 60;
+      thread_foreach (mlfqs_update_recent_cpu, NULL);
+    }
+  else if (tick % TIME_SLICE == 0 && t != idle_thread)
+    mlfqs_update_priority (t);
+
+  if (ready_mask != 0 && ready_queue_max_priority () > t->priority)
+    intr_yield_on_return ();
+}
+
+// Returns the priority that T should have under the MLFQS, given
+// its recent_cpu and nice values.
+static int
+mlfqs_priority (const struct thread *t)
+{
+  int priority = PRI_MAX - fp_to_int (t->recent_cpu / 4) - t->nice * 2;
+
+  if (priority < PRI_MIN)
+    priority = PRI_MIN;
+  else if (priority > PRI_MAX)
+    priority = PRI_MAX;
+  return priority;
+}
+
+// Recomputes T's priority from its recent_cpu and nice values,
+// moving T to its new run queue if it is ready.
+// Must be called with interrupts turned off.
+static void
+mlfqs_update_priority (struct thread *t)
+{
+  change_priority (t, mlfqs_priority (t));
+}
+
+// Decays T's recent_cpu by the load average and recomputes its
+// priority.  Called once per second through thread_foreach().
+static void
+mlfqs_update_recent_cpu (struct thread *t, void *aux UNUSED)
+{
+  fixed_t twice_load = load_avg * 2;
+
+  if (t == idle_thread)
+    return;
+
+  t->recent_cpu = fp_mul (fp_div (twice_load, fp_add_int (twice_load, 1)),
+                          t->recent_cpu)
+                  + fp_from_int (t->nice);
+  mlfqs_update_priority (t);
+}
+
 /* Prints thread statistics. */
 void
 thread_print_stats (void)
 {
   printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
      idle_ticks, kernel_ticks, user_ticks);
+  lock_print_stats ();
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -249,6 +356,16 @@ thread_create (const char *name, int priority,
   init_thread (t, name, priority);
   tid = t->tid = allocate_tid ();
 
+  /* Under the MLFQS, the new thread inherits its parent's nice
+     and recent_cpu, and PRIORITY is ignored.  T is on no queue
+     yet, so its priority can simply be set. */
+  if (thread_mlfqs)
+    {
+      t->nice = thread_current ()->nice;
+      t->recent_cpu = thread_current ()->recent_cpu;
+      priority = t->priority = t->base_priority = mlfqs_priority (t);
+    }
+
   /* Stack frame for kernel_thread(). */
   kf = alloc_frame (t, sizeof *kf);
   kf->eip = NULL;
@@ -291,7 +408,7 @@ thread_sleep_until (int64_t ticks_end)
   t->sleep_endtick = ticks_end;
 
   // put T into the wait queue
-  list_push_back (&wait_list, &t->waitelem);
+  heap_push (&sleep_heap, &t->sleepelem);
 
   // make the current thread block (sleeped)
   thread_block();
@@ -334,12 +451,19 @@ thread_unblock (struct thread *t)
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
 
-  list_insert_ordered (&ready_list, &t->elem, comparator_greater_thread_priority, NULL);
+  ready_queue_push (t);
 
   t->status = THREAD_READY;
 
   if (thread_current() != idle_thread && thread_current()->priority < t->priority )
-    thread_yield();
+    {
+      // an interrupt handler (e.g. waking sleepers at a timer tick)
+      // can't switch threads itself; preempt once it returns
+      if (intr_context ())
+        intr_yield_on_return ();
+      else
+        thread_yield();
+    }
 
   intr_set_level (old_level);
 }
@@ -383,7 +507,10 @@ void
 thread_exit (void)
 {
   ASSERT (!intr_context ());
+
+#ifdef USERPROG
   process_exit ();
+#endif
 
   /* Remove thread from all threads list, set our status to dying,
      and schedule another process.  That process will destroy us
@@ -407,7 +534,7 @@ thread_yield (void)
 
   old_level = intr_disable ();
   if (cur != idle_thread) {
-    list_insert_ordered (&ready_list, &cur->elem, comparator_greater_thread_priority, NULL);
+    ready_queue_push (cur);
   }
   cur->status = THREAD_READY;
   schedule ();
@@ -431,11 +558,128 @@ thread_foreach (thread_action_func *func, void *aux)
     }
 }
 
-/* Sets the current thread's priority to NEW_PRIORITY */
+/* Sets the current thread's base priority to NEW_PRIORITY.  A
+   higher donated priority stays in effect until it is released.
+   Yields if the current thread no longer has the highest
+   priority.  Ignored under the MLFQS, which computes priorities
+   itself. */
 void
 thread_set_priority (int new_priority)
 {
-  thread_current()->priority = new_priority;
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  if (thread_mlfqs)
+    return;
+
+  old_level = intr_disable ();
+  cur->base_priority = new_priority;
+  thread_priority_refresh (cur);
+  thread_yield_to_higher_priority ();
+  intr_set_level (old_level);
+}
+
+/* Raises T's effective priority to PRIORITY on behalf of a
+   thread that is waiting for a lock T holds.  Has no effect if
+   T's priority is already at least PRIORITY.
+
+   Must be called with interrupts turned off. */
+void
+thread_priority_donate (struct thread *t, int priority)
+{
+  ASSERT (is_thread (t));
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (priority > t->priority)
+    change_priority (t, priority);
+}
+
+/* Recomputes T's effective priority as the larger of its base
+   priority and the highest priority donated to any lock it
+   holds.  The cost is proportional to the number of locks held
+   by T, not to the number of threads waiting for them.
+
+   Must be called with interrupts turned off. */
+void
+thread_priority_refresh (struct thread *t)
+{
+  struct list_elem *e;
+  int priority = t->base_priority;
+
+  ASSERT (is_thread (t));
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (e = list_begin (&t->locks); e != list_end (&t->locks);
+       e = list_next (e))
+    {
+      struct lock *lock = list_entry (e, struct lock, elem);
+      if (lock->max_priority > priority)
+        priority = lock->max_priority;
+    }
+  change_priority (t, priority);
+}
+
+/* Yields the CPU if some ready thread has a higher priority than
+   the running thread.  From an interrupt handler, the yield
+   happens just before the handler returns. */
+void
+thread_yield_to_higher_priority (void)
+{
+  enum intr_level old_level = intr_disable ();
+
+  if (ready_mask != 0
+      && ready_queue_max_priority () > thread_current ()->priority)
+    {
+      if (intr_context ())
+        intr_yield_on_return ();
+      else
+        thread_yield ();
+    }
+  intr_set_level (old_level);
+}
+
+/* Initializes WAITERS as an empty heap of waiting threads, in
+   which the thread with the highest effective priority is at the
+   front, and threads of equal priority leave in arrival order. */
+void
+thread_waiters_init (struct heap *waiters)
+{
+  heap_init (waiters, comparator_less_waiter, NULL);
+}
+
+/* Adds the running thread to WAITERS.  The thread stays
+   positioned by its priority, even if that changes through
+   donation, until thread_waiters_pop() removes it.
+
+   Must be called with interrupts turned off. */
+void
+thread_waiters_push (struct heap *waiters)
+{
+  struct thread *cur = thread_current ();
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (cur->wait_heap == NULL);
+
+  cur->wait_seq = next_wait_seq++;
+  cur->wait_heap = waiters;
+  heap_push (waiters, &cur->waitelem);
+}
+
+/* Removes and returns the highest-priority thread in WAITERS,
+   which must not be empty.  O(log n) amortized.
+
+   Must be called with interrupts turned off. */
+struct thread *
+thread_waiters_pop (struct heap *waiters)
+{
+  struct thread *t;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  t = heap_entry (heap_pop (waiters), struct thread, waitelem);
+  ASSERT (t->wait_heap == waiters);
+  t->wait_heap = NULL;
+  return t;
 }
 
 /* Returns the current thread's priority. */
@@ -445,35 +689,55 @@ thread_get_priority (void)
   return thread_current ()->priority;
 }
 
-/* Sets the current thread's nice value to NICE. */
+/* Sets the current thread's nice value to NICE, recomputes its
+   priority, and yields if it no longer has the highest
+   priority. */
 void
-thread_set_nice (int nice UNUSED)
+thread_set_nice (int nice)
 {
-  /* Not yet implemented. */
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  if (nice < NICE_MIN)
+    nice = NICE_MIN;
+  else if (nice > NICE_MAX)
+    nice = NICE_MAX;
+
+  old_level = intr_disable ();
+  cur->nice = nice;
+  if (thread_mlfqs)
+    {
+      mlfqs_update_priority (cur);
+      thread_yield_to_higher_priority ();
+    }
+  intr_set_level (old_level);
 }
 
 /* Returns the current thread's nice value. */
 int
 thread_get_nice (void)
 {
-  /* Not yet implemented. */
-  return 0;
+  return thread_current ()->nice;
 }
 
 /* Returns 100 times the system load average. */
 int
 thread_get_load_avg (void)
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int load = fp_round (load_avg * 100);
+  intr_set_level (old_level);
+  return load;
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int
 thread_get_recent_cpu (void)
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int recent_cpu = fp_round (thread_current ()->recent_cpu * 100);
+  intr_set_level (old_level);
+  return recent_cpu;
 }
 
 // Idle thread.  Executes when no other thread is ready to run.
@@ -561,7 +825,12 @@ init_thread (struct thread *t, const char *name, int priority)
   t->status = THREAD_BLOCKED;
   strlcpy (t->name, name, sizeof t->name);
   t->stack = (uint8_t *) t + PGSIZE;
-  t->priority = priority;
+  t->priority = t->base_priority = priority;
+  list_init (&t->locks);
+  t->waiting_lock = NULL;
+  t->wait_heap = NULL;
+  t->nice = NICE_DEFAULT;
+  t->recent_cpu = 0;
   t->fileindex = 2; 
   t->sleep_endtick = 0;
   t->magic = THREAD_MAGIC;
@@ -593,10 +862,18 @@ alloc_frame (struct thread *t, size_t size)
 static struct thread *
 next_thread_to_run (void)
 {
-  if (list_empty (&ready_list))
+  struct list *queue;
+  struct thread *next;
+
+  if (ready_mask == 0)
     return idle_thread;
-  else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
+
+  queue = &ready_queues[ready_queue_max_priority ()];
+  next = list_entry (list_pop_front (queue), struct thread, elem);
+  if (list_empty (queue))
+    ready_mask &= ~((uint64_t) 1 << next->priority);
+  ready_cnt--;
+  return next;
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -683,17 +960,103 @@ allocate_tid (void)
   return tid;
 }
 
+// Appends T to the run queue for its priority.
+// Must be called with interrupts turned off.
+static void
+ready_queue_push (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (PRI_MIN <= t->priority && t->priority <= PRI_MAX);
+
+  list_push_back (&ready_queues[t->priority], &t->elem);
+  ready_mask |= (uint64_t) 1 << t->priority;
+  ready_cnt++;
+}
+
+// Removes ready thread T from its run queue.
+// Must be called with interrupts turned off.
+static void
+ready_queue_remove (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (t->status == THREAD_READY);
+
+  list_remove (&t->elem);
+  if (list_empty (&ready_queues[t->priority]))
+    ready_mask &= ~((uint64_t) 1 << t->priority);
+  ready_cnt--;
+}
+
+// Sets T's priority to PRIORITY.  If T is ready, it is moved to
+// the back of the run queue for its new priority.
+// Must be called with interrupts turned off.
+static void
+change_priority (struct thread *t, int priority)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (t->priority == priority)
+    return;
+
+  if (t->status == THREAD_READY)
+    {
+      ready_queue_remove (t);
+      t->priority = priority;
+      ready_queue_push (t);
+    }
+  else
+    t->priority = priority;
+
+  // a waiter's place in its semaphore or condvar heap depends on
+  // its priority too
+  if (t->wait_heap != NULL)
+    heap_update (t->wait_heap, &t->waitelem);
+}
+
+// Returns the highest priority that has a nonempty run queue.
+// The ready queues must not all be empty.
+static int
+ready_queue_max_priority (void)
+{
+  uint32_t word = ready_mask >> 32;
+  int base = 32;
+  int bit;
+
+  ASSERT (ready_mask != 0);
+
+  if (word == 0)
+    {
+      word = ready_mask;
+      base = 0;
+    }
+  asm ("bsrl %1, %0" : "=r" (bit) : "rm" (word));
+  return base + bit;
+}
+
 static bool
-comparator_greater_thread_priority (
-    const struct list_elem *a,
-    const struct list_elem *b, void *aux UNUSED)
+comparator_less_sleep_endtick (
+    const struct heap_elem *a,
+    const struct heap_elem *b, void *aux UNUSED)
 {
   struct thread *ta, *tb;
-  ta = list_entry (a, struct thread, elem);
-  tb = list_entry (b, struct thread, elem);
-  return ta->priority > tb->priority;
+  ta = heap_entry (a, struct thread, sleepelem);
+  tb = heap_entry (b, struct thread, sleepelem);
+  return ta->sleep_endtick < tb->sleep_endtick;
 }
 
+// Higher effective priority first, then first come first served.
+static bool
+comparator_less_waiter (
+    const struct heap_elem *a,
+    const struct heap_elem *b, void *aux UNUSED)
+{
+  struct thread *ta, *tb;
+  ta = heap_entry (a, struct thread, waitelem);
+  tb = heap_entry (b, struct thread, waitelem);
+  if (ta->priority != tb->priority)
+    return ta->priority > tb->priority;
+  return ta->wait_seq < tb->wait_seq;
+}
 
 /* Offset of `stack' member within `struct thread'.
    Used by switch.S, which can't figure it out on its own. */
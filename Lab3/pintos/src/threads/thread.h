@@ -34,9 +34,11 @@
 #define THREADS_THREAD_H
 
 #include <debug.h>
+#include <heap.h>
 #include <list.h>
 #include <stdint.h>
 #include "semaphore.h"
+#include "threads/fixed-point.h"
 #include "filesys/file.h"
 #ifdef VM
 #include "vm/page.h"
@@ -61,6 +63,11 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* Thread niceness, for the MLFQS. */
+#define NICE_MIN -20                    /* Nicest to other threads. */
+#define NICE_DEFAULT 0                  /* Default niceness. */
+#define NICE_MAX 20                     /* Least nice to other threads. */
+
 /* 
 // A kernel thread or user process.
 //
@@ -113,12 +120,10 @@ typedef int tid_t;
 //   set to THREAD_MAGIC.  Stack overflow will normally change this
 //   value, triggering the assertion. 
 //
-//   The `elem' member has a dual purpose.  It can be an element in
-//   the run queue(thread.c), or it can be an element in a
-//   semaphore wait list(synch.c).  It can be used these two ways
-//   only because they are mutually exclusive: only a thread in the
-//   ready state is on the run queue, whereas only a thread in the
-//   blocked state is on a semaphore wait list. 
+//   The `elem' member is an element in a run queue(thread.c).
+//   Threads waiting on a semaphore or condition variable are
+//   instead kept in a heap through `waitelem', ordered by priority
+//   so that the highest-priority waiter is woken first. 
 */
 struct thread
   {
@@ -127,7 +132,12 @@ struct thread
     enum thread_status status;  // Thread state
     char name[16];              // Name(for debugging purposes)
     uint8_t *stack;             // Saved stack pointer
-    int priority;               // Priority
+    int priority;               // Effective priority, including donations
+    int base_priority;          // Priority before donations
+    struct list locks;          // Locks held, that may receive donations
+    struct lock *waiting_lock;  // Lock being waited for, if any
+    int nice;                   // Niceness, for the MLFQS
+    fixed_t recent_cpu;         // Recent CPU time received, for the MLFQS
     struct list_elem allelem;   // List element for all threads list
     
     struct file* filesys[32];   // Filesystem
@@ -136,11 +146,14 @@ struct thread
 
 
 
-    struct list_elem waitelem;  // List element, stored in the wait_list queue 
+    struct heap_elem sleepelem; // Heap element, stored in the sleep_heap queue
     int64_t sleep_endtick;      // The tick after which the thread should wakeup 
 
-    // Shared between thread.c and smeaphore.c. 
-    struct list_elem elem;      // List element for the semaphore wiaitng list or the global ready_list
+    // Shared between thread.c, semaphore.c and condvar.c. 
+    struct list_elem elem;      // List element for a ready queue
+    struct heap_elem waitelem;  // Heap element for semaphore or condvar waiters
+    struct heap *wait_heap;     // Waiters heap holding waitelem, if any
+    uint64_t wait_seq;          // Arrival order among waiters of equal priority
 
     // Owned by userprog/process.c. 
     uint32_t *pagedir;     // Pointer to the page directory
@@ -191,6 +204,12 @@ void thread_foreach(thread_action_func *, void *);
 int thread_get_priority(void);
 void thread_set_priority(int);
 void thread_priority_donate(struct thread *, int priority);
+void thread_priority_refresh(struct thread *);
+void thread_yield_to_higher_priority(void);
+
+void thread_waiters_init(struct heap *);
+void thread_waiters_push(struct heap *);
+struct thread *thread_waiters_pop(struct heap *);
 
 int thread_get_nice(void);
 void thread_set_nice(int);
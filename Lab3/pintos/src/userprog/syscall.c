@@ -40,6 +40,7 @@
 #include <stdlib.h>
 #include "devices/shutdown.h"
 #include "devices/input.h"
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/file.h"
 #include "filesys/inode.h"
@@ -73,6 +74,8 @@ static void exec_handler(struct intr_frame *f);
 pid_t sys_exec(const char * cmd_line);
 static void wait_handler(struct intr_frame *f);
 int sys_wait(pid_t);
+static void fsync_handler(struct intr_frame *f);
+static bool sys_fsync(int fd);
 
 
 static struct semaphore sema_esp;
@@ -142,6 +145,10 @@ syscall_handler(struct intr_frame *f)
    wait_handler(f);
    break;
 
+  case SYS_FSYNC:
+    fsync_handler(f);
+    break;
+
   default:
     printf("[ERROR] system call %d is unimplemented!\n", syscall);
     thread_exit();
@@ -305,3 +312,21 @@ static void wait_handler(struct intr_frame *f){
     umem_read(f->esp + 4, &pid, sizeof(&pid));
     f->eax = sys_wait(pid);
 }
+
+/*
+ * The buffer cache does not track which sectors belong to which
+ * file, so syncing one file writes back everything that is dirty.
+ */
+static bool sys_fsync(int fd){
+    struct thread *t = thread_current();
+    if (fd < 0 || fd >= (int) (sizeof t->filesys / sizeof *t->filesys)
+        || t->filesys[fd] == NULL)
+        return false;
+    buffer_cache_sync();
+    return true;
+}
+static void fsync_handler(struct intr_frame *f){
+    int fd;
+    umem_read(f->esp + 4, &fd, sizeof(fd));
+    f->eax = sys_fsync(fd);
+}
@@ -41,13 +41,11 @@ swap_index_t vm_swap_out (void *page)
   // Find an available block region to use
   size_t swap_index = bitmap_scan (swap_available, /*start*/0, /*cnt*/1, true);
 
-  size_t i;
-  for (i = 0; i < SECTORS_PER_PAGE; ++ i) {
-    block_write(swap_block,
-        /* sector number */  swap_index * SECTORS_PER_PAGE + i,
-        /* target address */ page + (BLOCK_SECTOR_SIZE * i)
-        );
-  }
+  // write the whole page with a single request
+  block_write_multiple (swap_block,
+      /* sector number */  swap_index * SECTORS_PER_PAGE,
+      /* sector count */   SECTORS_PER_PAGE,
+      /* source address */ page);
 
   // occupy the slot: available becomes false
   bitmap_set(swap_available, swap_index, false);
@@ -67,13 +65,11 @@ void vm_swap_in (swap_index_t swap_index, void *page)
     PANIC ("Error, invalid read access to unassigned swap block");
   }
 
-  size_t i;
-  for (i = 0; i < SECTORS_PER_PAGE; ++ i) {
-    block_read (swap_block,
-        /* sector number */  swap_index * SECTORS_PER_PAGE + i,
-        /* target address */ page + (BLOCK_SECTOR_SIZE * i)
-        );
-  }
+  // read the whole page with a single request
+  block_read_multiple (swap_block,
+      /* sector number */  swap_index * SECTORS_PER_PAGE,
+      /* sector count */   SECTORS_PER_PAGE,
+      /* target address */ page);
 
   bitmap_set(swap_available, swap_index, true);
 }